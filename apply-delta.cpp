@@ -0,0 +1,97 @@
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "ascii-codec.h"
+#include "state-file.h"
+
+// Rebuilds what a run with --delta would have printed without it: the board of the state
+// file the run started from, with the changed cells of the delta, between the header of the
+// delta and the lines that follow its cells.
+
+void print_usage(char** argv) {
+    using std::cerr;
+    using std::endl;
+    cerr << "Usage:" << endl;
+    cerr << "\t" << argv[0] << " <initial-state-file> <delta-file>" << endl;
+    cerr << "Prints the state that the run which printed <delta-file> with --delta would have" << endl;
+    cerr << "printed without it: the state, in the format of the state file, then the steps." << endl;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        print_usage(argv);
+        return 1;
+    }
+    std::ifstream state(argv[1]);
+    if (!state) {
+        std::cerr << "Can not open file " << std::quoted(argv[1]) << std::endl;
+        return 1;
+    }
+    GameInfo game;
+    std::vector<int> rule;
+    int visited_state[1 << 5];
+    size_t total_visited_state;
+    std::vector<WormState> worms;
+    bool own_bindings;
+    std::vector<std::string> board_ascii;
+    std::string error = read_state_header(state, game, rule, visited_state, total_visited_state, worms, own_bindings);
+    if (error.empty()) error = read_state_board(state, game, board_ascii);
+    if (!error.empty()) {
+        std::cerr << "Error while parsing state file: " << error << std::endl;
+        return 1;
+    }
+    size_t height = game.height, width = game.width;
+    std::vector<char> cells(height * width);
+    for (size_t r = 0; r < height; ++r) {
+        decode_ascii_row(board_ascii[2 * r].data(), board_ascii[2 * r + 1].data(), width, &cells[r * width]);
+    }
+
+    std::ifstream delta(argv[2]);
+    if (!delta) {
+        std::cerr << "Can not open file " << std::quoted(argv[2]) << std::endl;
+        return 1;
+    }
+    // the header is printed as it is, it only has to be for a board of the same size.
+    std::vector<std::string> header;
+    std::string line;
+    while (std::getline(delta, line) && line.compare(0, 6, "delta ") != 0) {
+        header.push_back(line);
+    }
+    size_t delta_height = 0, delta_width = 0, count = 0;
+    if (!header.empty()) std::istringstream(header[0]) >> delta_height >> delta_width;
+    if (!delta || !(std::istringstream(line.substr(6)) >> count)) {
+        std::cerr << "Error while parsing delta file: Cannot find the line `delta <count>`" << std::endl;
+        return 1;
+    }
+    if (delta_height != height || delta_width != width) {
+        std::cerr << "The delta is for a board of " << delta_height << "x" << delta_width
+                  << ", not " << height << "x" << width << std::endl;
+        return 1;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        size_t row, col;
+        int cell;
+        if (!(delta >> row >> col >> cell) || row >= height || col >= width || cell < 0 || cell >= 8) {
+            std::cerr << "Error while parsing delta file: Invalid changed cell #" << i + 1 << std::endl;
+            return 1;
+        }
+        cells[row * width + col] = cell;
+    }
+    // what the run printed after the board (the steps it did) is printed after it as well.
+    std::vector<std::string> trailer;
+    delta >> std::ws;
+    while (std::getline(delta, line)) {
+        trailer.push_back(line);
+    }
+
+    for (size_t r = 0; r < height; ++r) {
+        encode_ascii_row(&cells[r * width], width, &board_ascii[2 * r][0], &board_ascii[2 * r + 1][0]);
+    }
+    for (auto& header_line: header) std::cout << header_line << '\n';
+    for (auto& board_line: board_ascii) std::cout << board_line << '\n';
+    for (auto& trailer_line: trailer) std::cout << trailer_line << '\n';
+    return 0;
+}
@@ -0,0 +1,115 @@
+#include "ascii-codec.h"
+#include "utils.h"
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// In a 16-bit lane the first byte is the character at 2c and the second the one at 2c + 1,
+// so one lane of the lines is one cell. The bits the characters of each line stand for:
+static const short odd_chars = ('\\' << 8) | '|', odd_bits = (2 << 8) | 4;
+// the '*' is compared with the bit 0 of nothing, so it is always drawn.
+static const short even_chars = ('=' << 8) | '*', even_bits = 1 << 8;
+
+#if defined(__AVX2__)
+static const size_t block = 32;
+
+static void decode_block(const char* even, const char* odd, char* cells) {
+    const __m256i odd_c = _mm256_set1_epi16(odd_chars), odd_b = _mm256_set1_epi16(odd_bits);
+    const __m256i even_c = _mm256_set1_epi16(even_chars & ~0xFF), even_b = _mm256_set1_epi16(even_bits);
+    const __m256i low = _mm256_set1_epi16(0xFF);
+    __m256i half[2];
+    for (int i = 0; i < 2; ++i) {
+        __m256i o = _mm256_loadu_si256((const __m256i*)(odd + 32 * i));
+        __m256i e = _mm256_loadu_si256((const __m256i*)(even + 32 * i));
+        __m256i v = _mm256_or_si256(_mm256_and_si256(_mm256_cmpeq_epi8(o, odd_c), odd_b),
+                                    _mm256_and_si256(_mm256_cmpeq_epi8(e, even_c), even_b));
+        half[i] = _mm256_and_si256(_mm256_or_si256(v, _mm256_srli_epi16(v, 8)), low);
+    }
+    // the pack works in each 128-bit lane, so its 64-bit quarters are 0 2 1 3.
+    __m256i res = _mm256_permute4x64_epi64(_mm256_packus_epi16(half[0], half[1]), _MM_SHUFFLE(3, 1, 2, 0));
+    _mm256_storeu_si256((__m256i*)cells, res);
+}
+
+static void encode_block(const char* cells, char* even, char* odd) {
+    const __m256i odd_c = _mm256_set1_epi16(odd_chars), odd_b = _mm256_set1_epi16(odd_bits);
+    const __m256i even_c = _mm256_set1_epi16(even_chars), even_b = _mm256_set1_epi16(even_bits);
+    const __m256i spaces = _mm256_set1_epi8(' ');
+    // the same order of quarters as above, so the unpacks give the cells 0-15 and 16-31.
+    __m256i x = _mm256_permute4x64_epi64(_mm256_loadu_si256((const __m256i*)cells), _MM_SHUFFLE(3, 1, 2, 0));
+    __m256i dup[2] = {_mm256_unpacklo_epi8(x, x), _mm256_unpackhi_epi8(x, x)};
+    for (int i = 0; i < 2; ++i) {
+        __m256i o = _mm256_cmpeq_epi8(_mm256_and_si256(dup[i], odd_b), odd_b);
+        __m256i e = _mm256_cmpeq_epi8(_mm256_and_si256(dup[i], even_b), even_b);
+        _mm256_storeu_si256((__m256i*)(odd + 32 * i), _mm256_blendv_epi8(spaces, odd_c, o));
+        _mm256_storeu_si256((__m256i*)(even + 32 * i), _mm256_blendv_epi8(spaces, even_c, e));
+    }
+}
+#elif defined(__SSE2__)
+static const size_t block = 16;
+
+static void decode_block(const char* even, const char* odd, char* cells) {
+    const __m128i odd_c = _mm_set1_epi16(odd_chars), odd_b = _mm_set1_epi16(odd_bits);
+    const __m128i even_c = _mm_set1_epi16(even_chars & ~0xFF), even_b = _mm_set1_epi16(even_bits);
+    const __m128i low = _mm_set1_epi16(0xFF);
+    __m128i half[2];
+    for (int i = 0; i < 2; ++i) {
+        __m128i o = _mm_loadu_si128((const __m128i*)(odd + 16 * i));
+        __m128i e = _mm_loadu_si128((const __m128i*)(even + 16 * i));
+        __m128i v = _mm_or_si128(_mm_and_si128(_mm_cmpeq_epi8(o, odd_c), odd_b),
+                                 _mm_and_si128(_mm_cmpeq_epi8(e, even_c), even_b));
+        half[i] = _mm_and_si128(_mm_or_si128(v, _mm_srli_epi16(v, 8)), low);
+    }
+    _mm_storeu_si128((__m128i*)cells, _mm_packus_epi16(half[0], half[1]));
+}
+
+static void encode_block(const char* cells, char* even, char* odd) {
+    const __m128i odd_c = _mm_set1_epi16(odd_chars), odd_b = _mm_set1_epi16(odd_bits);
+    const __m128i even_c = _mm_set1_epi16(even_chars), even_b = _mm_set1_epi16(even_bits);
+    const __m128i spaces = _mm_set1_epi8(' ');
+    __m128i x = _mm_loadu_si128((const __m128i*)cells);
+    __m128i dup[2] = {_mm_unpacklo_epi8(x, x), _mm_unpackhi_epi8(x, x)};
+    for (int i = 0; i < 2; ++i) {
+        __m128i o = _mm_cmpeq_epi8(_mm_and_si128(dup[i], odd_b), odd_b);
+        __m128i e = _mm_cmpeq_epi8(_mm_and_si128(dup[i], even_b), even_b);
+        _mm_storeu_si128((__m128i*)(odd + 16 * i), _mm_or_si128(_mm_and_si128(o, odd_c), _mm_andnot_si128(o, spaces)));
+        _mm_storeu_si128((__m128i*)(even + 16 * i), _mm_or_si128(_mm_and_si128(e, even_c), _mm_andnot_si128(e, spaces)));
+    }
+}
+#else
+static const size_t block = 0;
+
+static void decode_block(const char*, const char*, char*) {}
+static void encode_block(const char*, char*, char*) {}
+#endif
+
+void decode_ascii_row(const char* even, const char* odd, size_t width, char* cells) {
+    size_t c = 0;
+    if (block) {
+        for (; c + block <= width; c += block) {
+            decode_block(even + 2 * c, odd + 2 * c, cells + c);
+        }
+    }
+    for (; c < width; ++c) {
+        char cur = 0;
+        cur = cur << 1 | (odd[c * 2] == '|');
+        cur = cur << 1 | (odd[c * 2 + 1] == '\\');
+        cur = cur << 1 | (even[c * 2 + 1] == '=');
+        cells[c] = cur;
+    }
+}
+
+void encode_ascii_row(const char* cells, size_t width, char* even, char* odd) {
+    size_t c = 0;
+    if (block) {
+        for (; c + block <= width; c += block) {
+            encode_block(cells + c, even + 2 * c, odd + 2 * c);
+        }
+    }
+    for (; c < width; ++c) {
+        int cur = cells[c];
+        even[c * 2] = '*';
+        odd[c * 2] = GETBIT(cur, 2) ? '|' : ' ';
+        odd[c * 2 + 1] = GETBIT(cur, 1) ? '\\' : ' ';
+        even[c * 2 + 1] = GETBIT(cur, 0) ? '=' : ' ';
+    }
+}
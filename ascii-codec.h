@@ -0,0 +1,14 @@
+#pragma once
+#include <cstddef>
+
+// The conversion between a row of cells and its two lines of the ASCII board: the even
+// line holds '*' and '=' (bit 0), the odd one '|' (bit 2) and '\\' (bit 1), two characters
+// per cell. Built with AVX2 (`make AVX2=1`) or SSE2 when the compiler has them, 32 or 16
+// cells at a time, and cell by cell otherwise.
+
+// the cells of `width` cells from the lines, which start at the first cell and hold at
+// least 2 * width characters. Any other character is no edge.
+void decode_ascii_row(const char* even, const char* odd, size_t width, char* cells);
+
+// the lines of `width` cells, 2 * width characters from the first cell of each.
+void encode_ascii_row(const char* cells, size_t width, char* even, char* odd);
@@ -0,0 +1,148 @@
+#include <algorithm>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include "batch.h"
+#include "checkpoint.h"
+#include "sequential-engine.h"
+#include "state-file.h"
+#include "trace.h"
+
+std::string read_manifest(const std::string& filename, std::vector<BatchJob>& jobs) {
+    std::ifstream inp(filename);
+    if (!inp) return "Can not open file \"" + filename + "\"";
+    std::string line;
+    for (int line_id = 1; std::getline(inp, line); ++line_id) {
+        std::istringstream ss(line);
+        BatchJob job;
+        job.line = line_id;
+        std::string iteration_count, rest;
+        if (!(ss >> job.state_file) || job.state_file[0] == '#') continue;
+        if (!(ss >> iteration_count >> job.output_file) || ss >> rest) {
+            return "Error while parsing manifest: line " + std::to_string(line_id)
+                   + " must be <state-file> <iteration-count> <output-file>";
+        }
+        try {
+            size_t end;
+            job.iteration_count = std::stoul(iteration_count, &end);
+            if (end != iteration_count.size() || iteration_count[0] == '-') throw 0;
+        } catch (...) {
+            return "Error while parsing manifest: invalid iteration count at line " + std::to_string(line_id);
+        }
+        jobs.push_back(job);
+    }
+    return "";
+}
+
+// Returns an error message, or an empty string once the output is written.
+static std::string run_job(const BatchJob& job) {
+    GameInfo game;
+    std::vector<int> rule;
+    int visited_state[1 << 5];
+    size_t total_visited_state;
+    std::vector<std::string> board_ascii;
+    bool checkpoint = is_checkpoint(job.state_file);
+    std::string error = checkpoint
+        ? read_checkpoint_header(job.state_file, game, rule, visited_state, total_visited_state)
+        : read_state_file(job.state_file, game, rule, visited_state, total_visited_state, board_ascii);
+    if (!error.empty()) return error;
+    // the worm of a finished game is dead, it must not move anymore.
+    game.iteration_count = game.worm.dir == -1 ? 0 : job.iteration_count;
+    SequentialGame seq(game, rule, visited_state, total_visited_state);
+    if (checkpoint) {
+        if (!read_checkpoint_cells(job.state_file, seq.cells)) return "Cannot read the cells of the checkpoint";
+        board_ascii.assign(2 * game.height, std::string(2 * game.width, ' '));
+    } else {
+        seq.read_board(board_ascii);
+    }
+    seq.run();
+    seq.write_board(board_ascii);
+
+    std::ofstream out(job.output_file);
+    write_state(out, seq.game, seq.rule, seq.visited_state, seq.total_visited_state, board_ascii);
+    out << "Stepped iterations: " << seq.steps_done << '\n';
+    out.close();
+    if (!out) return "Cannot write file \"" + job.output_file + "\"";
+    return "";
+}
+
+// The jobs left to a thread: it takes them from the back, and the threads that have run out
+// of jobs steal them from the front.
+struct JobQueue {
+    std::mutex mutex;
+    std::deque<int> jobs;
+};
+
+// No job is added once the threads run, so there is nothing left when every queue is empty.
+static bool take_job(std::vector<JobQueue>& queues, int thread_id, int& job) {
+    {
+        auto& own = queues[thread_id];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.jobs.empty()) {
+            job = own.jobs.back();
+            own.jobs.pop_back();
+            return true;
+        }
+    }
+    for (size_t i = 1; i < queues.size(); ++i) {
+        auto& victim = queues[(thread_id + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.jobs.empty()) {
+            job = victim.jobs.front();
+            victim.jobs.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+int run_batch(const std::vector<BatchJob>& jobs, int thread_count) {
+    std::vector<int> own_jobs;
+    for (int i = world_rank; i < (int)jobs.size(); i += world_size) {
+        own_jobs.push_back(i);
+    }
+    thread_count = std::max(1, std::min(thread_count, (int)own_jobs.size()));
+    // the jobs are dealt to the threads in turn, each thread running its own from the first.
+    std::vector<JobQueue> queues(thread_count);
+    for (size_t i = 0; i < own_jobs.size(); ++i) {
+        queues[i % thread_count].jobs.push_front(own_jobs[i]);
+    }
+
+    std::vector<std::string> errors(jobs.size());
+    // phase_stats is per thread, the ones of the workers are added to the ones of this thread.
+    std::mutex stats_mutex;
+    PhaseStats worker_stats[PHASE_COUNT] = {};
+    auto worker = [&](int thread_id) {
+        int job;
+        while (take_job(queues, thread_id, job)) {
+            errors[job] = run_job(jobs[job]);
+        }
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        for (int i = 0; i < PHASE_COUNT; ++i) {
+            worker_stats[i].count += phase_stats[i].count;
+            worker_stats[i].bytes += phase_stats[i].bytes;
+            worker_stats[i].seconds += phase_stats[i].seconds;
+        }
+    };
+    std::vector<std::thread> threads;
+    for (int i = 1; i < thread_count; ++i) {
+        threads.emplace_back(worker, i);
+    }
+    worker(0);
+    for (auto& thread: threads) thread.join();
+    // this thread has added its own stats already.
+    for (int i = 0; i < PHASE_COUNT; ++i) {
+        phase_stats[i] = worker_stats[i];
+    }
+
+    int failed = 0;
+    for (int job: own_jobs) {
+        if (errors[job].empty()) continue;
+        std::cerr << "Job at line " << jobs[job].line << " (" << jobs[job].state_file << "): " << errors[job] << std::endl;
+        ++failed;
+    }
+    return failed;
+}
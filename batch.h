@@ -0,0 +1,23 @@
+#pragma once
+#include <string>
+#include <vector>
+
+// One line of the manifest of --batch:
+//     <state-file> <iteration-count> <output-file>
+// Empty lines and lines starting with # are skipped.
+struct BatchJob {
+    // the line of the manifest, to tell the jobs apart in the errors.
+    int line;
+    std::string state_file;
+    unsigned long iteration_count;
+    std::string output_file;
+};
+
+// Returns an error message, or an empty string if the manifest is valid.
+std::string read_manifest(const std::string& filename, std::vector<BatchJob>& jobs);
+
+// Runs the jobs of this process, the job i going to the process i % world_size, on
+// thread_count threads. Each job is a sequential run of its state file (or checkpoint),
+// whose final state is written to its output file as build/main would print it. The errors
+// are printed to stderr, and the jobs that failed are counted.
+int run_batch(const std::vector<BatchJob>& jobs, int thread_count);
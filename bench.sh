@@ -0,0 +1,80 @@
+#!/bin/bash
+# Runs build/main on generated boards for every board size, iteration count and process
+# count, and prints one CSV line per run. The settings come from the environment:
+#   SIZES       board sides, the board is SIZE x SIZE (default "256 1024")
+#   ITERATIONS  iteration counts (default "100000 1000000")
+#   NPS         process counts (default "1 2 4")
+#   MODES       `strong` keeps the board, `weak` makes it NP times taller (default "strong weak")
+#   RULE, SEED, PATTERN  passed to build/generate (default 1,5,4,5,1, 1, empty)
+#   MPIRUN      the launcher (default "mpirun --oversubscribe")
+#
+# The efficiency is relative to the distributed run with one process of the same setting,
+# so NPS should start with 1. `match` tells whether the final state is the same as the one
+# of that run (strong only); the script fails if any is not.
+
+SIZES=${SIZES:-"256 1024"}
+ITERATIONS=${ITERATIONS:-"100000 1000000"}
+NPS=${NPS:-"1 2 4"}
+MODES=${MODES:-"strong weak"}
+RULE=${RULE:-"1,5,4,5,1"}
+SEED=${SEED:-1}
+PATTERN=${PATTERN:-empty}
+MPIRUN=${MPIRUN:-"mpirun --oversubscribe"}
+
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+# run <np> <state-file> <iterations> <engine> -> sets SECONDS_TAKEN, STEPS, RSS_KB, OUTPUT
+run() {
+    local np=$1 file=$2 iterations=$3 engine=$4
+    local start end
+    start=$(date +%s%N)
+    if [ "$np" = 1 ]; then
+        build/main "$file" "$iterations" --$engine --stats text > "$DIR/out" 2> "$DIR/stats"
+    else
+        $MPIRUN -np "$np" build/main "$file" "$iterations" --stats text > "$DIR/out" 2> "$DIR/stats"
+    fi
+    end=$(date +%s%N)
+    SECONDS_TAKEN=$(awk -v s="$start" -v e="$end" 'BEGIN { printf "%.6f", (e - s) / 1e9 }')
+    STEPS=$(awk '/^Stepped iterations:/ { print $3 }' "$DIR/out")
+    RSS_KB=$(awk '/max-rss-kb/ { rss = 1; next } rss { sum += $2 } END { print sum + 0 }' "$DIR/stats")
+    OUTPUT=$(md5sum < "$DIR/out" | cut -d' ' -f1)
+}
+
+fail=0
+echo "mode,engine,np,height,width,iterations,steps,seconds,steps_per_sec,efficiency,max_rss_kb,match"
+for mode in $MODES; do
+for size in $SIZES; do
+for iterations in $ITERATIONS; do
+    base_seconds=""
+    base_output=""
+    for np in $NPS; do
+        height=$size
+        [ "$mode" = weak ] && height=$((size * np))
+        file="$DIR/board-$height-$size.txt"
+        [ -f "$file" ] || build/generate "$height" "$size" --seed "$SEED" --pattern "$PATTERN" --rule "$RULE" > "$file"
+        engines=distributed
+        [ "$np" = 1 ] && engines="distributed sequential"
+        for engine in $engines; do
+            run "$np" "$file" "$iterations" "$engine"
+            if [ "$np" = 1 ] && [ "$engine" = distributed ]; then
+                base_seconds=$SECONDS_TAKEN
+                base_output=$OUTPUT
+            fi
+            efficiency=$(awk -v b="$base_seconds" -v t="$SECONDS_TAKEN" -v np="$np" -v mode="$mode" 'BEGIN {
+                if (b == "" || t == 0) { print "-"; exit }
+                printf "%.3f", mode == "strong" ? b / (np * t) : b / t
+            }')
+            match=-
+            if [ "$mode" = strong ] && [ -n "$base_output" ]; then
+                match=$([ "$OUTPUT" = "$base_output" ] && echo yes || echo no)
+                [ "$match" = no ] && fail=1
+            fi
+            steps_per_sec=$(awk -v s="$STEPS" -v t="$SECONDS_TAKEN" 'BEGIN { printf "%.0f", t ? s / t : 0 }')
+            echo "$mode,$engine,$np,$height,$size,$iterations,$STEPS,$SECONDS_TAKEN,$steps_per_sec,$efficiency,$RSS_KB,$match"
+        done
+    done
+done
+done
+done
+exit $fail
@@ -0,0 +1,90 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include "checkpoint.h"
+
+bool is_checkpoint(const std::string& filename) {
+    std::ifstream inp(filename, std::ios::binary);
+    char magic[sizeof(checkpoint_magic)];
+    if (!inp.read(magic, sizeof(magic))) return false;
+    return std::memcmp(magic, checkpoint_magic, sizeof(magic)) == 0;
+}
+
+CheckpointHeader make_checkpoint_header(const GameInfo& game, const std::vector<int>& rule, const int* visited_state, size_t total_visited_state) {
+    CheckpointHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, checkpoint_magic, sizeof(header.magic));
+    header.height = game.height;
+    header.width = game.width;
+    header.worm_row = game.worm.row;
+    header.worm_col = game.worm.col;
+    header.worm_dir = game.worm.dir;
+    header.rule_count = rule.size();
+    std::copy(rule.begin(), rule.end(), header.rule);
+    header.total_visited_state = total_visited_state;
+    std::copy(visited_state, visited_state + (1 << 5), header.visited_state);
+    return header;
+}
+
+std::string read_checkpoint_header(const std::string& filename, GameInfo& game,
+        std::vector<int>& rule, int* visited_state, size_t& total_visited_state, size_t offset) {
+    std::ifstream inp(filename, std::ios::binary);
+    inp.seekg(offset);
+    CheckpointHeader header;
+    if (!inp.read((char*)&header, sizeof(header))) {
+        return "the header is truncated";
+    }
+    if (std::memcmp(header.magic, checkpoint_magic, sizeof(header.magic)) != 0) {
+        return "wrong magic";
+    }
+    if (header.rule_count > checkpoint_max_rule || header.total_visited_state > (1 << 5)) {
+        return "the rule is too long";
+    }
+    // a dead worm (direction -1) can be restored, it just will not move.
+    if (header.worm_row < 0 || header.worm_row >= (int64_t)header.height
+            || header.worm_col < 0 || header.worm_col >= (int64_t)header.width
+            || header.worm_dir < -1 || header.worm_dir >= 6) {
+        return "the worm is out of range";
+    }
+    for (size_t i = 0; i < header.rule_count; ++i) {
+        if (header.rule[i] < 0 || header.rule[i] >= 6 || header.rule[i] == 3) {
+            return "invalid rule";
+        }
+    }
+    for (int i = 0; i < (1 << 5); ++i) {
+        if (header.visited_state[i] < -1 || header.visited_state[i] >= (int)header.total_visited_state) {
+            return "invalid visited state";
+        }
+    }
+    inp.seekg(0, std::ios::end);
+    if ((uint64_t)inp.tellg() < offset + checkpoint_size(header.height, header.width)) {
+        return "the cells are truncated";
+    }
+    game.height = header.height;
+    game.width = header.width;
+    game.worm.row = header.worm_row;
+    game.worm.col = header.worm_col;
+    game.worm.dir = header.worm_dir;
+    rule.assign(header.rule, header.rule + header.rule_count);
+    total_visited_state = header.total_visited_state;
+    std::copy(header.visited_state, header.visited_state + (1 << 5), visited_state);
+    return "";
+}
+
+bool read_checkpoint_cells(const std::string& filename, std::vector<char>& cells, size_t offset) {
+    std::ifstream inp(filename, std::ios::binary);
+    inp.seekg(offset + checkpoint_cells_offset);
+    return (bool)inp.read(cells.data(), cells.size());
+}
+
+bool write_checkpoint(const std::string& filename, const CheckpointHeader& header,
+        const std::vector<char>& cells, size_t offset) {
+    std::ofstream out(filename, offset ? std::ios::binary | std::ios::in | std::ios::out
+                                       : std::ios::binary | std::ios::trunc);
+    out.seekp(offset);
+    std::vector<char> padded(checkpoint_cells_offset, 0);
+    std::memcpy(padded.data(), &header, sizeof(header));
+    out.write(padded.data(), padded.size());
+    out.write(cells.data(), cells.size());
+    return (bool)out;
+}
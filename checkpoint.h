@@ -0,0 +1,50 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "state.h"
+
+// A binary checkpoint is a header padded to checkpoint_cells_offset bytes, followed by the
+// cells of the board row by row, one byte per cell with the same bits as in ChessBoardRegion.
+// The numbers are in the byte order of the machine that wrote it. Several checkpoints of the
+// same board can follow each other in one file (see --keyframes), each one at a given offset.
+static const char checkpoint_magic[8] = {'W', 'O', 'R', 'M', 'C', 'K', 'P', '1'};
+static const size_t checkpoint_cells_offset = 512;
+// the longest rule a checkpoint holds: one entry per reduced state, the others could never be
+// used but would still be printed, so a longer rule is refused rather than cut.
+static const size_t checkpoint_max_rule = 1 << 5;
+
+struct CheckpointHeader {
+    char magic[8];
+    uint64_t height;
+    uint64_t width;
+    int64_t worm_row;
+    int64_t worm_col;
+    int64_t worm_dir;
+    uint64_t rule_count;
+    int32_t rule[checkpoint_max_rule];
+    uint64_t total_visited_state;
+    int32_t visited_state[1 << 5];
+};
+static_assert(sizeof(CheckpointHeader) <= checkpoint_cells_offset, "the header does not fit");
+
+// true if the file starts with checkpoint_magic.
+bool is_checkpoint(const std::string& filename);
+
+// The rule must have at most checkpoint_max_rule entries.
+CheckpointHeader make_checkpoint_header(const GameInfo& game, const std::vector<int>& rule, const int* visited_state, size_t total_visited_state);
+
+inline size_t checkpoint_size(size_t height, size_t width) {
+    return checkpoint_cells_offset + height * width;
+}
+
+// Returns an error message, or an empty string if the header is valid. The iteration count
+// of game is left as is.
+std::string read_checkpoint_header(const std::string& filename, GameInfo& game,
+        std::vector<int>& rule, int* visited_state, size_t& total_visited_state, size_t offset = 0);
+
+// For the runs in one process: the whole board, height * width cells.
+bool read_checkpoint_cells(const std::string& filename, std::vector<char>& cells, size_t offset = 0);
+// The file is truncated when the offset is 0.
+bool write_checkpoint(const std::string& filename, const CheckpointHeader& header,
+        const std::vector<char>& cells, size_t offset = 0);
@@ -1,7 +1,47 @@
+#include <cstring>
 #include "chess-board-region.h"
 
 ChessBoardRegion::ChessBoardRegion(size_t height_, size_t width_)
     : width(width_)
     , height(height_)
-    , cell_state(height + 1, std::vector<char>(width + 1))
+    , stride(stride_of(width))
+    , own_cells(storage_bytes(height, width))
+    , cell_state(own_cells.data())
 {}
+
+ChessBoardRegion::ChessBoardRegion(size_t height_, size_t width_, char* storage)
+    : width(width_)
+    , height(height_)
+    , stride(stride_of(width))
+    , cell_state(storage)
+{}
+
+#ifdef PACKED_CELLS
+size_t ChessBoardRegion::stride_of(size_t width) {
+    return width ? 2 + width / 2 : 1;
+}
+
+void ChessBoardRegion::read_row(int row, const char* data) {
+    for (size_t c = 0; c < width; ++c) {
+        set(row, c, data[c]);
+    }
+}
+
+void ChessBoardRegion::write_row(int row, char* data) const {
+    for (size_t c = 0; c < width; ++c) {
+        data[c] = operator()(row, c);
+    }
+}
+#else
+size_t ChessBoardRegion::stride_of(size_t width) {
+    return width + 1;
+}
+
+void ChessBoardRegion::read_row(int row, const char* data) {
+    std::memcpy(&cell_state[byte_of(row, 0)], data, width);
+}
+
+void ChessBoardRegion::write_row(int row, char* data) const {
+    std::memcpy(data, &cell_state[byte_of(row, 0)], width);
+}
+#endif
@@ -5,28 +5,98 @@
 #include <iostream>
 #include "utils.h"
 #include "state.h"
+#include "trace.h"
 
+// The cells of a region are kept in one buffer, row by row, with the ghost row and the
+// ghost column (the copies of the neighbour regions' cells) built in as row -1 and column -1.
+//
+// When compiled with PACKED_CELLS, two cells share a byte. The ghost cell and the last
+// cell of each row still get a whole byte, so the columns exchanged with the neighbours
+// can be described as plain strided bytes.
+//
+// The buffer is either the region's own, or memory given to it, such as a window shared by
+// the processes of a node (see --no-shared-memory), which also lets a process look at the
+// regions of the others through regions of their memory.
 class ChessBoardRegion {
     size_t width;
-    size_t height; 
-    std::vector<std::vector<char>> cell_state;
+    size_t height;
+    size_t stride;
+    std::vector<char> own_cells;
+    char* cell_state;
+
+    static size_t stride_of(size_t width);
+
+#ifdef PACKED_CELLS
+    inline size_t byte_of(int row, int col) const {
+        size_t base = (row + 1) * stride;
+        if (col < 0) return base;
+        if (col == (int)width - 1) return base + stride - 1;
+        return base + 1 + (col >> 1);
+    }
+    inline int shift_of(int col) const {
+        return col >= 0 && col < (int)width - 1 ? (col & 1) << 2 : 0;
+    }
+#else
+    inline size_t byte_of(int row, int col) const {
+        return (row + 1) * stride + (col + 1);
+    }
+#endif
 public:
     ChessBoardRegion(size_t height_, size_t row_);
-    
+    // on the storage_bytes(height_, width_) bytes of the storage, which is left as it is.
+    ChessBoardRegion(size_t height_, size_t width_, char* storage);
+    // the cell_state would point to the buffer of the other.
+    ChessBoardRegion(const ChessBoardRegion&) = delete;
+    ChessBoardRegion(ChessBoardRegion&&) = default;
+    ChessBoardRegion& operator=(ChessBoardRegion&&) = default;
+
+    static size_t storage_bytes(size_t height, size_t width) {
+        return (height + 1) * stride_of(width);
+    }
+
     inline int get_width() const { return width; }
     inline int get_height() const { return height; }
-    
+
     inline char operator()(int row, int col) const {
-        return cell_state[row + 1][col + 1];
+#ifdef PACKED_CELLS
+        return (cell_state[byte_of(row, col)] >> shift_of(col)) & 0xF;
+#else
+        return cell_state[byte_of(row, col)];
+#endif
     }
-    inline char & operator()(int row, int col) {
-        return cell_state[row + 1][col + 1];
+
+    inline void set(int row, int col, char value) {
+#ifdef PACKED_CELLS
+        char& cur = cell_state[byte_of(row, col)];
+        int shift = shift_of(col);
+        cur = (cur & ~(0xF << shift)) | (value << shift);
+#else
+        cell_state[byte_of(row, col)] = value;
+#endif
     }
-    
+
     inline int area() const {
         return width * height;
     }
-    
+
+    // Only for the ghost column and the last column, whose cells are whole bytes
+    // `get_stride()` apart.
+    inline char* cell_data(int row, int col) {
+        return &cell_state[byte_of(row, col)];
+    }
+    inline size_t get_stride() const { return stride; }
+
+    // The bytes of a row, without its ghost cell.
+    inline char* row_data(int row) {
+        return &cell_state[byte_of(row, 0)];
+    }
+    inline size_t row_bytes() const {
+        return width ? stride - 1 : 0;
+    }
+
+    void read_row(int row, const char* data);
+    void write_row(int row, char* data) const;
+
     inline char get_state(int row, int col) {
         char res = operator()(row, col);
         if (GETBIT(operator()(row, col - 1), 0)) {
@@ -38,12 +108,12 @@ public:
         if (GETBIT(operator()(row - 1, col), 2)) {
             res |= 1 << 5;
         }
-        
+
         return res;
     }
-    
+
     inline void upd_state(int row, int col, int dir) {
-        if (std::getenv("DEBUG")) {
+        if (LOG_ENABLED(LOG_TRACE)) {
             std::cout << "updating " << row << ' ' << col << " += " << dir << std::endl;
         }
         if (dir >= 3) {
@@ -52,7 +122,7 @@ public:
             upd_state(row, col, opposite_dir[dir]);
             return ;
         }
-        char& cur = operator()(row, col);
-        cur |= 1 << dir;
+        phase_stats[PHASE_CELL_UPDATE].count++;
+        set(row, col, operator()(row, col) | 1 << dir);
     }
 };
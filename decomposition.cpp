@@ -0,0 +1,122 @@
+#include <algorithm>
+#include "decomposition.h"
+
+int BlockGrid::row_block_of(int row) const {
+    return std::upper_bound(row_pos.begin(), row_pos.end(), (size_t)row) - row_pos.begin() - 1;
+}
+
+int BlockGrid::col_block_of(int col) const {
+    return std::upper_bound(col_pos.begin(), col_pos.end(), (size_t)col) - col_pos.begin() - 1;
+}
+
+static int next_block(const std::vector<size_t>& block_size, int id) {
+    do {
+        id = (id + 1) % block_size.size();
+    } while (block_size[id] == 0);
+    return id;
+}
+
+int BlockGrid::next_row_block(int row_block) const {
+    return next_block(row_size, row_block);
+}
+
+int BlockGrid::next_col_block(int col_block) const {
+    return next_block(col_size, col_block);
+}
+
+std::vector<std::pair<int, int>> BlockGrid::blocks_of(int rank) const {
+    std::vector<std::pair<int, int>> res;
+    for (int r = 0; r < row_blocks(); ++r)
+    for (int c = 0; c < col_blocks(); ++c) {
+        if (owner(r, c) == rank) res.emplace_back(r, c);
+    }
+    return res;
+}
+
+bool valid_layout(const std::string& layout) {
+    return layout == "diagonal" || layout == "rows" || layout == "grid" || layout == "worms";
+}
+
+// the first ones get one more when it does not divide evenly.
+static std::vector<size_t> even_sizes(size_t length, int parts) {
+    std::vector<size_t> res(parts);
+    for (int i = 0; i < parts; ++i) {
+        res[i] = length / parts + ((size_t)i < length % parts);
+    }
+    return res;
+}
+
+// The cuts are where the running sum of the weight (one per line, plus the same total again
+// spread over the points) crosses each share, so a part holds either a share of the area or
+// a share of the points, and all of them is even when there is no point.
+static std::vector<size_t> weighted_sizes(size_t length, int parts, const std::vector<int>& coords) {
+    std::vector<double> weight(length, 1.0);
+    for (int x: coords) weight[x] += (double)length / coords.size();
+    double total = coords.empty() ? length : 2.0 * length;
+    std::vector<size_t> res(parts, 0);
+    double sum = 0;
+    int part = 0;
+    for (size_t i = 0; i < length; ++i) {
+        // the line goes to the part where its middle falls.
+        double middle = sum + weight[i] / 2;
+        while (part + 1 < parts && middle >= total * (part + 1) / parts) ++part;
+        ++res[part];
+        sum += weight[i];
+    }
+    return res;
+}
+
+static std::vector<size_t> positions(const std::vector<size_t>& sizes) {
+    std::vector<size_t> res(sizes.size());
+    for (size_t i = 1; i < sizes.size(); ++i) res[i] = res[i - 1] + sizes[i - 1];
+    return res;
+}
+
+BlockGrid make_block_grid(const std::string& layout, size_t height, size_t width, int ranks,
+                          const std::vector<std::pair<int, int>>& points) {
+    BlockGrid grid;
+    if (layout == "rows") {
+        grid.row_size = even_sizes(height, ranks);
+        grid.col_size = {width};
+        for (int r = 0; r < ranks; ++r) grid.owners.push_back(r);
+    } else if (layout == "grid" || layout == "worms") {
+        // the ghost cells of a block are a column of height / row_count cells and a row
+        // of width / col_count cells, so the factors are the ones with the fewest.
+        int row_count = 1;
+        double best = -1;
+        for (int r = 1; r <= ranks; ++r) {
+            if (ranks % r) continue;
+            double halo = (double)height / r + (double)width / (ranks / r);
+            if (best < 0 || halo < best) {
+                best = halo;
+                row_count = r;
+            }
+        }
+        int col_count = ranks / row_count;
+        if (layout == "grid") {
+            grid.row_size = even_sizes(height, row_count);
+            grid.col_size = even_sizes(width, col_count);
+        } else {
+            std::vector<int> rows, cols;
+            for (auto& point: points) {
+                rows.push_back(point.first);
+                cols.push_back(point.second);
+            }
+            grid.row_size = weighted_sizes(height, row_count, rows);
+            grid.col_size = weighted_sizes(width, col_count, cols);
+        }
+        for (int r = 0; r < ranks; ++r) grid.owners.push_back(r);
+    } else {
+        // the diagonal: the rank that holds the block (r, c) is the one that has it on its
+        // diagonal, every rank holding one block of each row and each column.
+        grid.row_size = even_sizes(height, ranks);
+        grid.col_size = even_sizes(width, ranks);
+        for (int r = 0; r < ranks; ++r)
+        for (int c = 0; c < ranks; ++c) {
+            grid.owners.push_back((c - r + ranks) % ranks);
+        }
+    }
+    grid.row_pos = positions(grid.row_size);
+    grid.col_pos = positions(grid.col_size);
+    return grid;
+}
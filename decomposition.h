@@ -0,0 +1,40 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// How the board is cut into blocks and which process holds each one (see --layout). The
+// blocks of a row of blocks all have the same height and the ones of a column the same
+// width; a block may be empty when the board is smaller than the grid. Every process holds
+// one region per block it owns, in the order of blocks_of.
+struct BlockGrid {
+    std::vector<size_t> row_size, col_size;
+    std::vector<size_t> row_pos, col_pos;
+    // the owner of the block (r, c) is at r * col_blocks() + c.
+    std::vector<int> owners;
+
+    int row_blocks() const { return row_size.size(); }
+    int col_blocks() const { return col_size.size(); }
+    int block_id(int row_block, int col_block) const { return row_block * col_blocks() + col_block; }
+    int owner(int row_block, int col_block) const { return owners[block_id(row_block, col_block)]; }
+
+    int row_block_of(int row) const;
+    int col_block_of(int col) const;
+    int owner_of(int row, int col) const { return owner(row_block_of(row), col_block_of(col)); }
+
+    // the nearest block with positive size after the given one, wrapping around the board.
+    int next_row_block(int row_block) const;
+    int next_col_block(int col_block) const;
+
+    // the blocks (row block, column block) of the rank, row by row.
+    std::vector<std::pair<int, int>> blocks_of(int rank) const;
+};
+
+// the layouts of --layout.
+bool valid_layout(const std::string& layout);
+
+// The grid of the layout for a board of the given size, where points are the cells the work
+// is around (the worms of a worm list) for the worms layout, as (row, col). The grid is made
+// once, it does not follow the worms.
+BlockGrid make_block_grid(const std::string& layout, size_t height, size_t width, int ranks,
+                          const std::vector<std::pair<int, int>>& points = {});
@@ -0,0 +1,136 @@
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Writes a state file (see `main` without arguments for the format) for the benchmarks.
+
+static const int rule_values[] = {0, 1, 2, 4, 5};
+
+void print_usage(char** argv) {
+    using std::cerr;
+    using std::endl;
+    cerr << "Usage:" << endl;
+    cerr << "\t" << argv[0] << " <row-count> <column-count> [options]" << endl;
+    cerr << "Options:" << endl;
+    cerr << "\t--seed <n>\tthe seed of the random generator (default 1)." << endl;
+    cerr << "\t--pattern <p>\tthe edges already on the board:" << endl;
+    cerr << "\t\t\t`empty` (default), no edge;" << endl;
+    cerr << "\t\t\t`random`, every edge with the probability given by --density;" << endl;
+    cerr << "\t\t\t`lines`, a full row of horizontal edges every --spacing rows." << endl;
+    cerr << "\t--density <p>\tfor the `random` pattern (default 0.1)." << endl;
+    cerr << "\t--spacing <n>\tfor the `lines` pattern (default 8)." << endl;
+    cerr << "\t--rule <r0,r1,...>\tthe rule of the worm (default 1,5,4,5,1)." << endl;
+    cerr << "\t--rule-length <n>\ta random rule of this length instead." << endl;
+    cerr << "\t--worm <row,col,dir>\tthe worm (default at the middle, going right)." << endl;
+    cerr << "\t\t\t`random` for a random place and direction." << endl;
+}
+
+// "a,b,c" to {a, b, c}
+bool parse_list(const std::string& s, std::vector<long>& res) {
+    res.clear();
+    size_t pos = 0;
+    while (pos <= s.size()) {
+        size_t next = s.find(',', pos);
+        if (next == std::string::npos) next = s.size();
+        try {
+            res.push_back(std::stol(s.substr(pos, next - pos)));
+        } catch (...) {
+            return false;
+        }
+        pos = next + 1;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::string> positional;
+    unsigned long seed = 1;
+    std::string pattern = "empty";
+    double density = 0.1;
+    long spacing = 8;
+    std::vector<long> rule = {1, 5, 4, 5, 1};
+    int rule_length = 0;
+    std::string worm_arg;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+        if (arg.size() > 2 && arg.compare(0, 2, "--") == 0) {
+            if (i + 1 == argc) {
+                print_usage(argv);
+                return 1;
+            }
+            std::string value(argv[++i]);
+            try {
+                if (arg == "--seed") seed = std::stoul(value);
+                else if (arg == "--pattern") pattern = value;
+                else if (arg == "--density") density = std::stod(value);
+                else if (arg == "--spacing") spacing = std::stol(value);
+                else if (arg == "--rule-length") rule_length = std::stoi(value);
+                else if (arg == "--worm") worm_arg = value;
+                else if (arg == "--rule") {
+                    if (!parse_list(value, rule)) throw 0;
+                } else throw 0;
+            } catch (...) {
+                print_usage(argv);
+                return 1;
+            }
+        } else {
+            positional.push_back(arg);
+        }
+    }
+    long height, width;
+    try {
+        if (positional.size() != 2) throw 0;
+        height = std::stol(positional[0]);
+        width = std::stol(positional[1]);
+        if (height <= 0 || width <= 0) throw 0;
+        if (pattern != "empty" && pattern != "random" && pattern != "lines") throw 0;
+        if (spacing <= 0 || rule_length < 0 || rule_length > 32) throw 0;
+    } catch (...) {
+        print_usage(argv);
+        return 1;
+    }
+
+    std::mt19937_64 gen(seed);
+    if (rule_length) {
+        rule.resize(rule_length);
+        for (auto& x: rule) x = rule_values[gen() % 5];
+    }
+    for (auto x: rule) {
+        if (x < 0 || x >= 6 || x == 3) {
+            std::cerr << "Rule must be one of 0, 1, 2, 4 and 5" << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<long> worm = {height / 2, width / 2, 0};
+    if (worm_arg == "random") {
+        worm = {(long)(gen() % height), (long)(gen() % width), (long)(gen() % 6)};
+    } else if (!worm_arg.empty() && (!parse_list(worm_arg, worm) || worm.size() != 3
+            || worm[0] < 0 || worm[0] >= height || worm[1] < 0 || worm[1] >= width
+            || worm[2] < 0 || worm[2] >= 6)) {
+        std::cerr << "Invalid worm " << worm_arg << std::endl;
+        return 1;
+    }
+
+    std::ios::sync_with_stdio(false);
+    std::cout << height << ' ' << width << '\n';
+    std::cout << worm[0] << ' ' << worm[1] << ' ' << worm[2] << '\n';
+    std::cout << rule.size() << '\n';
+    for (auto x: rule) std::cout << x << ' ';
+    std::cout << '\n' << 0 << '\n';
+
+    std::bernoulli_distribution edge(pattern == "random" ? density : 0);
+    std::string even(2 * width, '.'), odd(2 * width, '.');
+    for (long r = 0; r < height; ++r) {
+        bool line = pattern == "lines" && r % spacing == 0;
+        for (long c = 0; c < width; ++c) {
+            even[c * 2] = '*';
+            even[c * 2 + 1] = line || edge(gen) ? '=' : '.';
+            odd[c * 2] = edge(gen) ? '|' : '.';
+            odd[c * 2 + 1] = edge(gen) ? '\\' : '.';
+        }
+        std::cout << even << '\n' << odd << '\n';
+    }
+    return 0;
+}
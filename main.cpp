@@ -1,30 +1,108 @@
 #include <algorithm>
+#include <climits>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <thread>
 #include <utility>
 #include <iostream>
 #include <fstream>
 #include <mpi.h>
 #include <iomanip>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
 #include "state.h"
 #include "chess-board-region.h"
 #include "utils.h"
+#include "rule.h"
+#include "options.h"
+#include "sequential-engine.h"
+#include "sparse-engine.h"
+#include "sweep.h"
+#include "ascii-codec.h"
+#include "batch.h"
+#include "run-stats.h"
+#include "decomposition.h"
+#include "state-file.h"
+#include "trace.h"
+#include "checkpoint.h"
+#include "trajectory.h"
 
 
 char processor_name[MPI_MAX_PROCESSOR_NAME];
 int name_len;
 int world_size, world_rank;
 GameInfo game;
+Options options;
 
 #define log std::cout << processor_name << ":" << world_rank << "; "
 
 size_t total_visited_state;
 int visited_state[1 << 5];
 std::vector<int> rule;
+// filled while stepping, only reset when the rule is (re)received.
+TransitionTable transitions;
 
 std::vector<std::string> board_ascii;
+// the state file is a binary checkpoint, so the cells are read by every process from it.
+bool checkpoint_input = false;
+// the path of the worm, for the steps done by this process, with --trajectory.
+std::unique_ptr<TrajectoryLog> trajectory;
+// the keyframes of --keyframes written so far, and the step where the worm stops for the next one.
+unsigned long keyframe_count = 0;
+unsigned long next_keyframe_step = ULONG_MAX;
+std::ofstream keyframe_index;
+// the run stats of the steps done by this process and, with --metrics, the file of their
+// time series on rank 0, the step of its last line and the step where the worm stops for the next.
+RunStats run_stats;
+// with --metrics, the cells of each region of this process read so far.
+std::vector<VisitedCells> region_visited;
+std::ofstream metrics_out;
+unsigned long last_metrics_step = ULONG_MAX;
+unsigned long next_metrics_step = ULONG_MAX;
+double metrics_start;
+MPI_Datatype run_stats_type = MPI_DATATYPE_NULL;
+MPI_Op run_stats_op = MPI_OP_NULL;
+// the worms of a state file with a worm list, known to every process (see run_worms).
+bool worm_list_input = false;
+std::vector<WormState> worms;
+// every worm binds the states it meets in its own WormState instead of visited_state.
+bool own_bindings = false;
+std::vector<TransitionTable> worm_transitions;
+// where the ASCII board starts in the state file, when every process reads its own part.
+size_t board_offset = 0;
 size_t total_area = 0;
 std::vector<ChessBoardRegion> regions;
-std::vector<size_t> row_size, col_size;
-std::vector<size_t> row_pos, col_pos;
+// the blocks of the board and their owners (see --layout).
+BlockGrid grid;
+// the block (row block, column block) of each region of this process, and the region of
+// each block of the grid, -1 for the blocks of the others.
+std::vector<std::pair<int, int>> region_blocks;
+std::vector<int> block_region;
+// the cells of the regions as read from the state file, for --delta.
+std::vector<char> initial_cells;
+// the processes of this node, and the rank in node_comm of every process, -1 for the ones
+// of the other nodes.
+MPI_Comm node_comm;
+std::vector<int> node_rank_of;
+// When the node has several processes, their regions are in one shared window: the halos
+// between them are written straight into the ghost cells, and rank 0 reads their cells for
+// the gather. node_regions are the regions of the others of the node, on their memory.
+MPI_Win region_window = MPI_WIN_NULL;
+std::vector<ChessBoardRegion> node_regions;
+std::vector<int> block_node_region;
+// the sizes of the regions in the window, for every process of the node one after the other.
+std::vector<std::pair<size_t, size_t>> window_region_sizes;
+
+// a cell changed by the run, for --delta.
+struct DeltaCell {
+    int row, col, cell;
+};
 
 void finalize_then_exit(int exit_code) {
     MPI_Finalize();
@@ -36,14 +114,105 @@ void finalize_then_exit(int exit_code) {
         finalize_then_exit(1); \
     } } while (0)
 
+// For a condition that every process checks on its own part: the first process where it
+// does not hold prints the message, then all of them exit. Every process must call it.
+#define collective_assert(cond, msg) do { \
+        int failed_ = (cond) ? world_size : world_rank, first_failed_; \
+        MPI_Allreduce(&failed_, &first_failed_, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD); \
+        if (first_failed_ == world_rank) { \
+            std::cerr << "Assertion error: " << #cond << ". " << msg << std::endl; \
+        } \
+        if (first_failed_ < world_size) finalize_then_exit(1); \
+    } while (0)
+
+// The same without exiting, for the errors a server answers with: the error of the first
+// process that has one, given to every process, or an empty string if none has.
+std::string collective_error(const std::string& error) {
+    int failed = error.empty() ? world_size : world_rank, first_failed;
+    MPI_Allreduce(&failed, &first_failed, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+    if (first_failed == world_size) return "";
+    std::string message = error;
+    size_t size = message.size();
+    MPI_Bcast(&size, sizeof(size_t), MPI_BYTE, first_failed, MPI_COMM_WORLD);
+    message.resize(size);
+    MPI_Bcast(&message[0], size, MPI_CHAR, first_failed, MPI_COMM_WORLD);
+    return message;
+}
+
 void print_usage(int argc, char** argv) {
     using std::cout;
     using std::endl;
     cout << "Usage:" << endl;
-    cout << "\t" << argv[0] << " <initial-state-file> <number-of-iteration>" << endl;
+    cout << "\t" << argv[0] << " <initial-state-file> <number-of-iteration> [options]" << endl;
+    cout << "\t" << argv[0] << " --batch <manifest> [--threads <n>] [--stats <text|json>]" << endl;
+    cout << "\t" << argv[0] << " --serve <socket> [--stats <text|json>]" << endl;
     cout << endl;
     cout << "The result will be written to stdout, so it can be redirected to file" << endl;
     cout << endl;
+    cout << "Options:" << endl;
+    cout << "\t--sequential\trun the whole board in the process 0, without any communication." << endl;
+    cout << "\t\t\tThis is the default when there is only one process." << endl;
+    cout << "\t--distributed\tdivide the board into regions even when there is only one process." << endl;
+    cout << "\t--layout <diagonal|rows|grid|worms>\thow the board is divided into the regions:" << endl;
+    cout << "\t\t\tdiagonal (default) cuts it into n x n blocks, each process holding one block" << endl;
+    cout << "\t\t\tof every row and every column; rows gives each process a band of rows; grid" << endl;
+    cout << "\t\t\tgives each process one block of the squarest grid of n blocks; worms is the" << endl;
+    cout << "\t\t\tsame grid with the cuts placed so the worms of a worm list are shared evenly" << endl;
+    cout << "\t\t\twhen the board is divided. The cuts do not move during the run, and a state file" << endl;
+    cout << "\t\t\twith one worm gets the plain grid." << endl;
+    cout << "\t--no-shared-memory\tsend the halos and the final board between the processes of a node as" << endl;
+    cout << "\t\t\tmessages, instead of keeping their regions in one shared window and reading them" << endl;
+    cout << "\t\t\tthere." << endl;
+    cout << "\t--sparse\tkeep only the parts of the board with an edge or visited by the worm," << endl;
+    cout << "\t\t\tin one process." << endl;
+    cout << "\t--infinite\tthe same, on the infinite plane: the board of the state file is put at (0, 0)" << endl;
+    cout << "\t\t\tand the worm does not wrap around. The smallest box holding every edge" << endl;
+    cout << "\t\t\tis printed, followed by where the initial board is in it." << endl;
+    cout << "\t--fast-forward\ton the sparse board, find when the worm repeats the same moves over" << endl;
+    cout << "\t\t\tempty cells and draw the repeated edges without moving it step by step." << endl;
+    cout << "\t--sweep <n>\trun every rule of length up to n (values 0, 1, 2, 4, 5) instead of" << endl;
+    cout << "\t\t\tthe rule of the state file, one rule per process at a time." << endl;
+    cout << "\t\t\tA rule is skipped if its mirror image gives the same run." << endl;
+    cout << "\t--sweep-list <file>\tthe same, with the rules read from the file, one per line, each of at" << endl;
+    cout << "\t\t\tmost 32 entries." << endl;
+    cout << "\t--checkpoint <file>\twrite the final state to the file as a binary checkpoint, each process" << endl;
+    cout << "\t\t\twriting its own regions, instead of printing it. A checkpoint can be given" << endl;
+    cout << "\t\t\tas <initial-state-file> to resume the run; with 0 iteration and without" << endl;
+    cout << "\t\t\t--checkpoint, it is printed in the format below. The rule of a checkpoint has at" << endl;
+    cout << "\t\t\tmost 32 entries, as many as the states it can be bound to (also for --keyframes)." << endl;
+    cout << "\t--delta\t\tprint the cells changed by the run instead of the board: the same lines up to" << endl;
+    cout << "\t\t\tthe board, then `delta <count>` and one `<row> <col> <cell>` line per changed cell," << endl;
+    cout << "\t\t\twhere <cell> has the bits 1 for `=`, 2 for `\\` and 4 for `|`. build/apply-delta" << endl;
+    cout << "\t\t\tprints from the state file and the delta what the run would have printed without it." << endl;
+    cout << "\t--trajectory <file>\trecord the path of the worm in the file, 3 bits per step (see" << endl;
+    cout << "\t\t\ttrajectory.h). With several processes, each one writes the steps it does" << endl;
+    cout << "\t\t\tto <file>.<rank>." << endl;
+    cout << "\t--keyframes <file>\twrite the board to the file as a binary checkpoint at the start and" << endl;
+    cout << "\t\t\tevery --keyframe-interval steps (default 1000000), one after the other." << endl;
+    cout << "\t\t\t<file>.index lists the step and the offset of each. See build/replay." << endl;
+    cout << "\t--metrics <file>\twrite the vital signs of the run to the file every --metrics-interval" << endl;
+    cout << "\t\t\tsteps (default 1000000) and at the end, one line each: the steps, the edges drawn," << endl;
+    cout << "\t\t\tthe cells reached for the first time, the box of the cells reached, the worms" << endl;
+    cout << "\t\t\tdead and the steps before the last one died (-1 for none), the seconds since the" << endl;
+    cout << "\t\t\tstart, and how many times each of the 32 states bound to the rule was read." << endl;
+    cout << "\t\t\tThe processes count their own steps and add them up in one reduction per line." << endl;
+    cout << "\t--stats <text|json>\tprint the time, the count and the bytes sent of every phase," << endl;
+    cout << "\t\t\tand the peak memory of every process, to stderr at the end." << endl;
+    cout << "\t--cache <file>\tkeep the results of a sweep in the file, and skip the rules found there." << endl;
+    cout << "\t--batch <manifest>\trun every job of the manifest, one per line:" << endl;
+    cout << "\t\t\t\t<state-file> <number-of-iteration> <output-file>" << endl;
+    cout << "\t\t\tEach job runs sequentially and its output file gets what would be printed for it." << endl;
+    cout << "\t\t\tA job has one worm: a state file with a worm list fails as a job." << endl;
+    cout << "\t\t\tThe jobs are dealt to the processes in turn, then to the threads of each process," << endl;
+    cout << "\t\t\tthe threads taking the jobs left by the others when they are done." << endl;
+    cout << "\t--serve <socket>\tlisten on the UNIX socket and run each request on the regions of every" << endl;
+    cout << "\t\t\tprocess, one at a time. A request is one line `<initial-state-file> <number-of-iteration>`," << endl;
+    cout << "\t\t\tanswered with what would be printed for it, sent as it is printed, or with" << endl;
+    cout << "\t\t\t`Error: <message>`, even when the board turns out not to be readable by every" << endl;
+    cout << "\t\t\tprocess, then the connection is closed. The request `quit` stops the server." << endl;
+    cout << "\t--threads <n>\tthe threads of each process for --batch, by default the cores of the node" << endl;
+    cout << "\t\t\tshared between its processes." << endl;
+    cout << endl;
     cout << "The file format of the state is as follows:" << endl;
     cout << "\t<row-count> <column-count>" << endl;
     cout << "\t<worms-row-position> <worms-column-position> <worm-direction>" << endl;
@@ -63,62 +232,54 @@ void print_usage(int argc, char** argv) {
     cout << "\t`-`, when connecting 2 cells in the same row, and can be used only in the even row." << endl;
     cout << "\t`|`, when connecting 2 cells in consecutive rows, and can be used only in the even column." << endl;
     cout << "\t`\\`, when connecting 2 cells in consecutive rows, and can be used only in the odd row and odd column." << endl;
+    cout << endl;
+    cout << "Several worms can be given by replacing the line of the worm with:" << endl;
+    cout << "\tworms <worm-count> <shared|own>" << endl;
+    cout << "\t<worms-row-position> <worms-column-position> <worm-direction>\t(one line per worm)" << endl;
+    cout << "With `shared`, the worms bind the states to the rule together and there is one list" << endl;
+    cout << "of visited states; with `own`, each worm has its own, one list after the other." << endl;
+    cout << "The direction of a dead worm is -1. At each step, every worm alive reads its state on" << endl;
+    cout << "the board as it was before the step, then moves; new shared states are bound in the order" << endl;
+    cout << "of the worms. When several worms take the same edge, the first one in the list draws it" << endl;
+    cout << "and the others stay where they are for this step. A step is counted when a worm moves." << endl;
+    cout << "Such a file is always run on the regions, even in one process." << endl;
 }
 
-void parse_state(int argc, char** argv) {
-    std::string filename(argv[1]);
-    game.iteration_count = std::stoul(argv[2]);
-    std::ifstream inp(filename);
-    if (!inp) {
-        std::cerr << "Can not open file " << std::quoted(filename) << std::endl;
+// Only the header of a checkpoint is read here, see read_checkpoint_regions.
+void parse_checkpoint_header() {
+    std::string error = read_checkpoint_header(options.state_file, game, rule, visited_state, total_visited_state);
+    if (!error.empty()) {
+        std::cerr << "Error while parsing checkpoint " << std::quoted(options.state_file) << ": " << error << std::endl;
         finalize_then_exit(1);
     }
-#define read(elm, label) do { if (!(inp >> elm)) { \
-    std::cerr << "Error while parsing state file: Cannot read " << label << std::endl; \
-    finalize_then_exit(1); \
-} } while (0) 
-
-    read(game.height, "<row-count>");
-    read(game.width, "<column-count>");
-    read(game.worm.row, "<worm-row-position>");
-    read(game.worm.col, "<worm-col-position>");
-    read(game.worm.dir, "<worm-direction>");
-    safe_assert(0 <= game.worm.row && game.worm.row < (int)game.height, "worm's row position is out of range.");
-    safe_assert(0 <= game.worm.col && game.worm.col < (int)game.width, "worm's column position is out of range.");
-    safe_assert(0 <= game.worm.dir && game.worm.dir < 6, "worm's direction must be an integer between 0 and 5.");
-    
-    size_t rule_count;
-    read(rule_count, "<number-of-rule>");
-    rule.resize(rule_count);
-    for (int i = 0; i < (int)rule_count; ++i) {
-        read(rule[i], "<rule-" << i << ">");
-        safe_assert(0 <= rule[i] && rule[i] < 6, "Rule must be an integer between 0 and 5");
-        safe_assert(rule[i] != 3, "Rule must not be 2 (cannot go back)");
-    }
-    
-    for (int i = 0; i < (1 << 5); ++i) {
-        visited_state[i] = -1;
+    // the worm of a finished game is dead, it must not move anymore.
+    if (game.worm.dir == -1) game.iteration_count = 0;
+}
+
+// With read_board false, only the header is parsed and the board is left to divide_states.
+void parse_state(bool read_board = true) {
+    const std::string& filename = options.state_file;
+    game.iteration_count = options.iteration_count;
+    if (checkpoint_input) {
+        parse_checkpoint_header();
+        return;
     }
-    total_visited_state = 0;
-    read(total_visited_state, "<number-of-visited-state>");
-    
-    for (int i = 0; i < (int)total_visited_state; ++i) {
-        int cur_state;
-        read(cur_state, "<visited-state-" << i << ">");
-        visited_state[cur_state] = i;
+    std::ifstream inp(filename);
+    std::string error = inp ? read_state_header(inp, game, rule, visited_state, total_visited_state, worms, own_bindings)
+                            : "Can not open file";
+    if (error.empty() && read_board) error = read_state_board(inp, game, board_ascii);
+    if (!error.empty()) {
+        std::cerr << "Error while parsing state file " << std::quoted(filename) << ": " << error << std::endl;
+        finalize_then_exit(1);
     }
-    board_ascii.resize(2 * game.height);
-    inp >> std::ws;
-    for (size_t i = 0; i < 2 * game.height; ++i) {
-        if (!std::getline(inp, board_ascii[i])) {
-            std::cerr << "Error while parsing state file: Cannot read the row #" << i + 1 << " of the board description."<< std::endl;
-            finalize_then_exit(1);
-        }
-        safe_assert(board_ascii[i].size() >= 2 * game.width, "The size of the row #" << i + 1 << " must be twice the board size, but found" << board_ascii[i].size());
+    safe_assert(rule.size() <= checkpoint_max_rule || (options.checkpoint_file.empty() && options.keyframe_file.empty()),
+                "A checkpoint holds at most " << checkpoint_max_rule << " entries of the rule.");
+    if (!read_board) {
+        board_offset = inp.tellg();
+        return;
     }
-#undef read
     
-    if (std::getenv("DEBUG")) {
+    if (LOG_ENABLED(LOG_DEBUG)) {
         for (size_t i = 0; i < 2 * game.height; ++i) {
             std::cout << std::quoted(board_ascii[i]) << std::endl;
         }
@@ -126,286 +287,1123 @@ void parse_state(int argc, char** argv) {
 }
 
 
-void divide_regions() {
-    row_size.resize(world_size);
-    col_size.resize(world_size);
-    row_pos.resize(world_size);
-    col_pos.resize(world_size);
-    for (size_t i = 0; i < (size_t) world_size; ++i) {
-        row_size[i] = game.height / world_size + (i < game.height % world_size);
-        col_size[i] = game.width / world_size + (i < game.width % world_size);
-        row_pos[i] = i ? row_pos[i - 1] + row_size[i - 1] : 0;
-        col_pos[i] = i ? col_pos[i - 1] + col_size[i - 1] : 0;
+// whether the state file lists several worms, see parse_state.
+bool has_worm_list(const std::string& filename) {
+    std::ifstream inp(filename);
+    size_t height, width;
+    std::string field;
+    return inp >> height >> width >> field && field == "worms";
+}
+
+void broadcast_worms() {
+    size_t worm_count = worms.size();
+    MPI_Bcast(&worm_count, sizeof(size_t), MPI_BYTE, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&own_bindings, sizeof(bool), MPI_BYTE, 0, MPI_COMM_WORLD);
+    worms.resize(worm_count);
+    MPI_Bcast(worms.data(), worm_count * sizeof(WormState), MPI_BYTE, 0, MPI_COMM_WORLD);
+}
+
+// the worm can be stepped by any process, so every process needs the rule.
+void broadcast_rule() {
+    size_t rule_count = rule.size();
+    MPI_Bcast(&rule_count, sizeof(size_t), MPI_BYTE, 0, MPI_COMM_WORLD);
+    rule.resize(rule_count);
+    MPI_Bcast(rule.data(), rule_count, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&total_visited_state, sizeof(size_t), MPI_BYTE, 0, MPI_COMM_WORLD);
+    MPI_Bcast(visited_state, 1 << 5, MPI_INT, 0, MPI_COMM_WORLD);
+    transitions.reset();
+}
+
+// whether the process is on this node and its regions are in the window.
+inline bool on_node(int rank) {
+    return region_window != MPI_WIN_NULL && node_rank_of[rank] >= 0;
+}
+
+// makes the writes of this process to the window seen by the others and theirs seen by it,
+// on both sides of a synchronisation of the processes.
+inline void sync_node_window() {
+    if (region_window != MPI_WIN_NULL) MPI_Win_sync(region_window);
+}
+
+// every process of the node must call it.
+void barrier_node_window() {
+    if (region_window == MPI_WIN_NULL) return;
+    MPI_Win_sync(region_window);
+    MPI_Barrier(node_comm);
+    MPI_Win_sync(region_window);
+}
+
+// when the regions are no longer needed, on every process.
+void free_node_window() {
+    if (region_window == MPI_WIN_NULL) return;
+    regions.clear();
+    node_regions.clear();
+    block_node_region.clear();
+    window_region_sizes.clear();
+    // rank 0 may still be reading the cells of the others.
+    MPI_Barrier(node_comm);
+    MPI_Win_unlock_all(region_window);
+    MPI_Win_free(&region_window);
+}
+
+// The regions of every process of the node, one after the other in the window, in the order
+// of their blocks. The window of the last grid (from the last game of --serve) is kept when
+// its regions have the same sizes, with the cells left as they are; else it is made again
+// with the cells cleared.
+void share_node_regions() {
+    std::vector<std::pair<size_t, size_t>> sizes;
+    for (int other = 0; other < world_size; ++other) {
+        if (node_rank_of[other] < 0) continue;
+        for (auto& block: grid.blocks_of(other)) {
+            sizes.emplace_back(grid.row_size[block.first], grid.col_size[block.second]);
+        }
     }
-    total_area = 0;
-    for (int i = 0; i < world_size; ++i) {
-        regions.emplace_back(row_size[i], col_size[(i + world_rank) % world_size]);
-        total_area += regions.back().area();
+    if (sizes != window_region_sizes) {
+        free_node_window();
+        size_t bytes = 0;
+        for (auto& block: region_blocks) {
+            bytes += ChessBoardRegion::storage_bytes(grid.row_size[block.first], grid.col_size[block.second]);
+        }
+        char* base;
+        MPI_Win_allocate_shared(bytes, 1, MPI_INFO_NULL, node_comm, &base, &region_window);
+        MPI_Win_lock_all(MPI_MODE_NOCHECK, region_window);
+        std::fill_n(base, bytes, 0);
+        window_region_sizes = sizes;
     }
-    if (std::getenv("DEBUG")) {
-        log << "dividing regions: ";
-        std::cout << total_area << "; ";
-        for (int i = 0; i < world_size; ++i) {
-            std::cout << regions[i].get_height() << "x" << regions[i].get_width() << ' ';
+    regions.clear();
+    node_regions.clear();
+    block_node_region.assign(grid.owners.size(), -1);
+    for (int other = 0; other < world_size; ++other) {
+        if (node_rank_of[other] < 0) continue;
+        MPI_Aint size;
+        int disp_unit;
+        char* storage;
+        MPI_Win_shared_query(region_window, node_rank_of[other], &size, &disp_unit, &storage);
+        for (auto& block: grid.blocks_of(other)) {
+            size_t height = grid.row_size[block.first], width = grid.col_size[block.second];
+            if (other == world_rank) {
+                regions.emplace_back(height, width, storage);
+            } else {
+                block_node_region[grid.block_id(block.first, block.second)] = node_regions.size();
+                node_regions.emplace_back(height, width, storage);
+            }
+            storage += ChessBoardRegion::storage_bytes(height, width);
         }
-        std::cout << std::endl;
     }
+    // the others write into the ghost cells once they are cleared, and into the cells once
+    // rank 0 has read the last ones.
+    barrier_node_window();
 }
 
-void divide_states() {
-    if (world_rank == 0) {
-        for (int other = 0; other < world_size; ++other) {
-            std::vector<char> data;
-            for (int reg = 0; reg < world_size; ++reg) {
-                int col_reg = (reg + other) % world_size;
-                for (size_t r = 0; r < row_size[reg]; ++r)
-                for (size_t c = 0; c < col_size[col_reg]; ++c) {
-                    int ascii_r = (r + row_pos[reg]) * 2;
-                    int ascii_c = (c + col_pos[col_reg]) * 2;
-                    char cur = 0;
-                    cur = cur << 1 | (board_ascii[ascii_r + 1][ascii_c] == '|');
-                    cur = cur << 1 | (board_ascii[ascii_r + 1][ascii_c + 1] == '\\');
-                    cur = cur << 1 | (board_ascii[ascii_r][ascii_c + 1] == '=');
-                    data.push_back(cur);
-                }
-            }
-            if (std::getenv("DEBUG")) {
-                log << "sending to " << other << ": ";
-                std::cout << data.size() << ": ";
-                for (auto x: data) std::cout << (int)x << ", ";
-                std::cout << std::endl;
+// the regions of this process for the blocks it owns in new_grid, keeping the buffers (or
+// the window, when the node is shared) of the ones that have the same size from the last
+// game of --serve. The cells are left as they are.
+void set_grid(const BlockGrid& new_grid) {
+    grid = new_grid;
+    region_blocks = grid.blocks_of(world_rank);
+    block_region.assign(grid.owners.size(), -1);
+    for (size_t i = 0; i < region_blocks.size(); ++i) {
+        block_region[grid.block_id(region_blocks[i].first, region_blocks[i].second)] = i;
+    }
+    int node_size;
+    MPI_Comm_size(node_comm, &node_size);
+    std::vector<ChessBoardRegion> old_regions;
+    old_regions.swap(regions);
+    if (options.shared_memory && node_size > 1) {
+        share_node_regions();
+    } else {
+        for (size_t i = 0; i < region_blocks.size(); ++i) {
+            int row_block = region_blocks[i].first, col_block = region_blocks[i].second;
+            size_t height = grid.row_size[row_block], width = grid.col_size[col_block];
+            if (i < old_regions.size() && old_regions[i].get_height() == (int)height && old_regions[i].get_width() == (int)width) {
+                regions.push_back(std::move(old_regions[i]));
+            } else {
+                regions.emplace_back(height, width);
             }
-            MPI_Send(data.data(), data.size(), MPI_BYTE, other, 0, MPI_COMM_WORLD);
         }
     }
-    
-    // receive the data
-    std::vector<char> board_data(total_area);
-    MPI_Recv(board_data.data(), total_area, MPI_BYTE, 0, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-    {
-        auto it = board_data.begin();
+    total_area = 0;
+    for (auto& reg: regions) {
+        total_area += reg.area();
+    }
+}
+
+void divide_regions() {
+    std::vector<std::pair<int, int>> points;
+    for (auto& w: worms) points.emplace_back(w.worm.row, w.worm.col);
+    set_grid(make_block_grid(options.layout, game.height, game.width, world_size, points));
+    if (LOG_ENABLED(LOG_DEBUG)) {
+        log << "dividing regions (" << options.layout << "): ";
+        std::cout << total_area << "; ";
         for (auto& reg: regions) {
-            for (int r = 0; r < reg.get_height(); ++r)
-            for (int c = 0; c < reg.get_width(); ++c) {
-                reg(r, c) = *it++;
-            }
+            std::cout << reg.get_height() << "x" << reg.get_width() << ' ';
         }
+        std::cout << std::endl;
     }
 }
 
-void extract_received_vertical(const std::vector<char>& data) {
-    auto it = data.begin();
+// The cells of the regions of this process, row by row, region after region.
+std::vector<char> region_cells() {
+    std::vector<char> board_data(total_area);
+    char* it = board_data.data();
     for (auto& reg: regions) {
-        for (int i = 0; i < reg.get_height(); ++i) {
-            reg(i, -1) = *it++;
+        for (int r = 0; r < reg.get_height(); ++r) {
+            reg.write_row(r, it);
+            it += reg.get_width();
         }
     }
+    return board_data;
 }
-void extract_received_horizontal(const std::vector<char>& data) {
-    auto it = data.begin();
+
+void store_region_cells(const std::vector<char>& board_data) {
+    const char* it = board_data.data();
     for (auto& reg: regions) {
-        for (int i = 0; i < reg.get_width(); ++i) {
-            reg(-1, i) = *it++;
+        for (int r = 0; r < reg.get_height(); ++r) {
+            reg.read_row(r, it);
+            it += reg.get_width();
         }
     }
 }
 
-void send_state_to_neighbor_vertical() {
-    if (std::getenv("DEBUG")) {
-        log << "sending vertical" << std::endl;
+// Every process maps the state file and decodes the cells of its own regions from it.
+// The lines of the board may be longer than needed, so they are found first: each process
+// looks for the line ends in its own slice of the board, then the slices are put together.
+std::string divide_states() {
+    PhaseTimer timer(PHASE_DIVIDE);
+    const std::string& filename = options.state_file;
+    int fd = open(filename.c_str(), O_RDONLY);
+    struct stat file_stat;
+    bool opened = fd != -1 && fstat(fd, &file_stat) == 0;
+    size_t file_size = opened ? file_stat.st_size : 0;
+    const char* file = nullptr;
+    if (opened && file_size > 0) {
+        void* mapped = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        opened = mapped != MAP_FAILED;
+        if (opened) file = (const char*)mapped;
     }
-    std::vector<char> data;
-    if (world_rank != 0) {
-        data.resize(game.height);
-        MPI_Recv(data.data(), game.height, MPI_BYTE, world_rank - 1, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        extract_received_vertical(data);
-        data.clear();
+    auto unmap = [&]() {
+        if (file) munmap((void*)file, file_size);
+        if (fd != -1) close(fd);
+    };
+    std::string error = collective_error(opened ? "" : "Can not open file \"" + filename + "\"");
+    if (!error.empty()) {
+        unmap();
+        return error;
     }
-    data.reserve(game.height);
-    for (auto& reg: regions) {
-        for (int i = 0; i < reg.get_height(); ++i) {
-            data.push_back(reg(i, reg.get_width() - 1));
-        }
+    
+    size_t board_size = file_size > board_offset ? file_size - board_offset : 0;
+    size_t slice = (board_size + world_size - 1) / world_size;
+    size_t begin = std::min(board_offset + slice * world_rank, file_size);
+    size_t end = std::min(begin + slice, file_size);
+    std::vector<unsigned long long> line_ends;
+    for (const char* it = file + begin; it < file + end; ++it) {
+        it = (const char*)std::memchr(it, '\n', file + end - it);
+        if (!it) break;
+        line_ends.push_back(it - file);
+    }
+    int count = line_ends.size();
+    std::vector<int> counts(world_size), displacements(world_size);
+    MPI_Allgather(&count, 1, MPI_INT, counts.data(), 1, MPI_INT, MPI_COMM_WORLD);
+    for (int i = 1; i < world_size; ++i) {
+        displacements[i] = displacements[i - 1] + counts[i - 1];
+    }
+    std::vector<unsigned long long> all_line_ends(displacements.back() + counts.back());
+    phase_stats[PHASE_DIVIDE].bytes += count * sizeof(unsigned long long);
+    MPI_Allgatherv(line_ends.data(), count, MPI_UNSIGNED_LONG_LONG,
+                   all_line_ends.data(), counts.data(), displacements.data(), MPI_UNSIGNED_LONG_LONG, MPI_COMM_WORLD);
+    // the last line may have no line end.
+    if (all_line_ends.empty() ? board_size > 0 : all_line_ends.back() + 1 < file_size) {
+        all_line_ends.push_back(file_size);
     }
     
-    MPI_Send(data.data(), game.height, MPI_BYTE, (world_rank + 1) % world_size, 0, MPI_COMM_WORLD);
+    // every process has the same line ends.
+    size_t line_count = all_line_ends.size();
+    if (line_count < 2 * game.height) {
+        unmap();
+        return "Cannot read the row #" + std::to_string(line_count + 1) + " of the board";
+    }
+    std::vector<char> row_data;
+    bool valid = true;
+    size_t invalid_line = 0, invalid_size = 0;
+    for (size_t reg = 0; reg < regions.size() && valid; ++reg) {
+        auto& region = regions[reg];
+        size_t top = grid.row_pos[region_blocks[reg].first], left = grid.col_pos[region_blocks[reg].second];
+        row_data.resize(region.get_width());
+        for (int r = 0; r < region.get_height() && valid; ++r) {
+            size_t line = (r + top) * 2;
+            const char* even = file + (line ? all_line_ends[line - 1] + 1 : board_offset);
+            const char* odd = file + all_line_ends[line] + 1;
+            for (size_t i = line; i < line + 2; ++i) {
+                size_t size = all_line_ends[i] - (i ? all_line_ends[i - 1] + 1 : board_offset);
+                if (size < 2 * game.width) {
+                    valid = false;
+                    invalid_line = i;
+                    invalid_size = size;
+                }
+            }
+            if (!valid) break;
+            decode_ascii_row(even + 2 * left, odd + 2 * left, region.get_width(), row_data.data());
+            region.read_row(r, row_data.data());
+        }
+    }
+    unmap();
+    return collective_error(valid ? "" : "The row #" + std::to_string(invalid_line + 1)
+                            + " of the board is shorter than twice the board size, found " + std::to_string(invalid_size));
+}
+
+// Where the cells of region_cells are in the cells of a checkpoint: one block per row
+// of each region.
+MPI_Datatype make_checkpoint_file_type() {
+    std::vector<int> lengths;
+    std::vector<MPI_Aint> displacements;
+    for (size_t reg = 0; reg < regions.size(); ++reg) {
+        if (regions[reg].get_width() == 0) continue;
+        size_t top = grid.row_pos[region_blocks[reg].first], left = grid.col_pos[region_blocks[reg].second];
+        for (int r = 0; r < regions[reg].get_height(); ++r) {
+            lengths.push_back(regions[reg].get_width());
+            displacements.push_back((MPI_Aint)(top + r) * game.width + left);
+        }
+    }
+    MPI_Datatype type;
+    MPI_Type_create_hindexed(lengths.size(), lengths.data(), displacements.data(), MPI_BYTE, &type);
+    MPI_Type_commit(&type);
+    return type;
+}
+
+// Every process reads its own regions from the checkpoint given as the state file.
+std::string read_checkpoint_regions() {
+    PhaseTimer timer(PHASE_CHECKPOINT);
+    MPI_File file;
+    int err = MPI_File_open(MPI_COMM_WORLD, options.state_file.c_str(), MPI_MODE_RDONLY, MPI_INFO_NULL, &file);
+    std::string error = collective_error(err == MPI_SUCCESS ? "" : "Can not open file \"" + options.state_file + "\"");
+    if (!error.empty()) return error;
+    MPI_Datatype file_type = make_checkpoint_file_type();
+    MPI_File_set_view(file, checkpoint_cells_offset, MPI_BYTE, file_type, "native", MPI_INFO_NULL);
+    std::vector<char> board_data(total_area);
+    MPI_File_read_all(file, board_data.data(), total_area, MPI_BYTE, MPI_STATUS_IGNORE);
+    MPI_File_close(&file);
+    MPI_Type_free(&file_type);
+    store_region_cells(board_data);
+    return "";
+}
+
+// Every process writes its own regions, so the board never has to fit in one process.
+// Anything after the checkpoint in the file is dropped.
+void write_checkpoint_regions(const std::string& filename, MPI_Offset offset = 0) {
+    PhaseTimer timer(PHASE_CHECKPOINT, total_area);
+    MPI_File file;
+    int err = MPI_File_open(MPI_COMM_WORLD, filename.c_str(), MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &file);
+    safe_assert(err == MPI_SUCCESS, "Can not open file " << std::quoted(filename));
+    MPI_File_set_size(file, offset + checkpoint_size(game.height, game.width));
     if (world_rank == 0) {
-        MPI_Recv(data.data(), game.height, MPI_BYTE, (world_size - 1 + world_size) % world_size, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        extract_received_vertical(data);
+        std::vector<char> padded(checkpoint_cells_offset, 0);
+        CheckpointHeader header = make_checkpoint_header(game, rule, visited_state, total_visited_state);
+        std::copy_n((const char*)&header, sizeof(header), padded.data());
+        MPI_File_write_at(file, offset, padded.data(), padded.size(), MPI_BYTE, MPI_STATUS_IGNORE);
     }
+    MPI_Datatype file_type = make_checkpoint_file_type();
+    MPI_File_set_view(file, offset + checkpoint_cells_offset, MPI_BYTE, file_type, "native", MPI_INFO_NULL);
+    std::vector<char> board_data = region_cells();
+    MPI_File_write_all(file, board_data.data(), total_area, MPI_BYTE, MPI_STATUS_IGNORE);
+    MPI_File_close(&file);
+    MPI_Type_free(&file_type);
+}
+
+int row_block_of(int row) {
+    return grid.row_block_of(row);
+}
+
+int col_block_of(int col) {
+    return grid.col_block_of(col);
+}
+
+int owner_of(int row, int col) {
+    return grid.owner_of(row, col);
+}
+
+// the region of this process holding the cell, and the position of the cell in it.
+int region_of(int row, int col, int& local_row, int& local_col) {
+    int row_block = row_block_of(row), col_block = col_block_of(col);
+    local_row = row - grid.row_pos[row_block];
+    local_col = col - grid.col_pos[col_block];
+    return block_region[grid.block_id(row_block, col_block)];
+}
+
+// whether the cell of the region is read for the first time, with --metrics.
+inline bool first_visit(int reg_id, int row, int col) {
+    return region_visited[reg_id].visit(row, col);
+}
+
+// A region's ghost column, ghost row and ghost corner are copies of the last column of the
+// region to the left, the last row of the region above and the last cell of the region to
+// the upper left. Each of these pieces is sent directly to the process that needs it,
+// described by MPI datatypes pointing into the regions so nothing is packed by hand.
+enum HaloPiece { HALO_COLUMN, HALO_ROW, HALO_CORNER, HALO_PIECE_COUNT };
+
+std::vector<MPI_Datatype> column_type;
+// requests that are still reading from or writing to each region.
+std::vector<std::vector<MPI_Request>> halo_requests;
+
+MPI_Datatype make_column_type(ChessBoardRegion& reg) {
+    MPI_Datatype type;
+    MPI_Type_vector(reg.get_height(), 1, reg.get_stride(), MPI_BYTE, &type);
+    MPI_Type_commit(&type);
+    return type;
 }
 
-void send_state_to_neighbor_horizontal() {
-    if (std::getenv("DEBUG")) {
-        log << "sending horizontal" << std::endl;
+void build_halo_types() {
+    halo_requests.assign(regions.size(), {});
+    for (auto& reg: regions) {
+        column_type.push_back(make_column_type(reg));
     }
-    std::vector<char> data;
-    if (world_rank != 0) {
-        data.resize(game.width);
-        MPI_Recv(data.data(), game.width, MPI_BYTE, (world_rank + 1) % world_size, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        extract_received_horizontal(data);
-        data.clear();
+}
+
+void free_halo_types() {
+    for (auto& type: column_type) {
+        MPI_Type_free(&type);
     }
-    data.reserve(game.width);
-    for (int prv = world_size - 1, id = 0; id < world_size; prv = id++) {
-        auto& reg = regions[prv];
-        for (int i = 0; i < reg.get_width(); ++i) {
-            data.push_back(reg(reg.get_height() - 1, i));
-        }
+    column_type.clear();
+}
+
+// the buffer and the datatype of a piece, either the one sent from the region or the one
+// received into it.
+void halo_piece(int reg_id, HaloPiece piece, bool ghost, char*& buf, int& count, MPI_Datatype& type) {
+    auto& reg = regions[reg_id];
+    int row = ghost ? -1 : reg.get_height() - 1;
+    int col = ghost ? -1 : reg.get_width() - 1;
+    switch (piece) {
+    case HALO_COLUMN:
+        buf = reg.cell_data(0, col);
+        count = 1;
+        type = column_type[reg_id];
+        break;
+    case HALO_ROW:
+        buf = reg.row_data(row);
+        count = reg.row_bytes();
+        type = MPI_BYTE;
+        break;
+    default:
+        buf = reg.cell_data(row, col);
+        count = 1;
+        type = MPI_BYTE;
     }
-    MPI_Send(data.data(), game.width, MPI_BYTE, (world_rank - 1 + world_size) % world_size, 0, MPI_COMM_WORLD);
-    if (world_rank == 0) {
-        MPI_Recv(data.data(), game.width, MPI_BYTE, 1 % world_size, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        extract_received_horizontal(data);
+}
+
+void copy_halo_piece(ChessBoardRegion& src, ChessBoardRegion& dest, HaloPiece piece) {
+    int h = src.get_height(), w = src.get_width();
+    if (piece == HALO_COLUMN) {
+        for (int r = 0; r < h; ++r) dest.set(r, -1, src(r, w - 1));
+    } else if (piece == HALO_ROW) {
+        std::copy_n(src.row_data(h - 1), src.row_bytes(), dest.row_data(-1));
+    } else {
+        dest.set(-1, -1, src(h - 1, w - 1));
     }
 }
 
-void send_inner() {
-    // we must do twice since there might be some regions with non-positive area.
-    for (int time = 0; time < 2; ++time) {
-        for (int prv = world_size - 1, cur = 0; cur < world_size; prv = cur++) {
-            regions[cur](-1, -1) = regions[prv](regions[prv].get_height() - 1, regions[prv].get_width() - 1);
+// Sends the boundary of the block (row_block, col_block) to the blocks whose ghost cells
+// mirror it. The requests are left running, see wait_region_halo.
+void start_halo_exchange(int row_block, int col_block) {
+    if (grid.row_size[row_block] == 0 || grid.col_size[col_block] == 0) return;
+    int owner = grid.owner(row_block, col_block);
+    int src = block_region[grid.block_id(row_block, col_block)];
+    int next_row = grid.next_row_block(row_block);
+    int next_col = grid.next_col_block(col_block);
+    const int dest_rows[] = {row_block, next_row, next_row};
+    const int dest_cols[] = {next_col, col_block, next_col};
+    for (int piece = 0; piece < HALO_PIECE_COUNT; ++piece) {
+        int dest_block = grid.block_id(dest_rows[piece], dest_cols[piece]);
+        int dest_owner = grid.owners[dest_block];
+        int dest = block_region[dest_block];
+        int tag = piece + HALO_PIECE_COUNT * dest_block;
+        char* buf;
+        int count;
+        MPI_Datatype type;
+        if (owner == world_rank && dest_owner == world_rank) {
+            copy_halo_piece(regions[src], regions[dest], (HaloPiece)piece);
+        } else if (on_node(owner) && on_node(dest_owner)) {
+            // written by the owner, see push_node_halo.
+            continue;
+        } else if (owner == world_rank) {
+            halo_piece(src, (HaloPiece)piece, false, buf, count, type);
+            int type_size;
+            MPI_Type_size(type, &type_size);
+            PhaseTimer timer((Phase)(PHASE_HALO_COLUMN + piece), (unsigned long)count * type_size);
+            halo_requests[src].emplace_back();
+            MPI_Isend(buf, count, type, dest_owner, tag, MPI_COMM_WORLD, &halo_requests[src].back());
+        } else if (dest_owner == world_rank) {
+            halo_piece(dest, (HaloPiece)piece, true, buf, count, type);
+            halo_requests[dest].emplace_back();
+            MPI_Irecv(buf, count, type, owner, tag, MPI_COMM_WORLD, &halo_requests[dest].back());
         }
     }
 }
 
-int query_state(int state) {
-    int reduced_state = state;
-    reduced_state &= (1 << 3) - 1;
-    int head = state >> 4;
-    reduced_state |= head << 3;
-    if (visited_state[reduced_state] == -1) {
-        visited_state[reduced_state] = total_visited_state++;
+// Writes the boundary of the block (row_block, col_block) of this process into the ghost
+// cells of the regions of the other processes of the node that mirror it. It must be done
+// before the others are told the block has changed, and the others must not be touching
+// their ghost cells, so only the process that has the worm can do it.
+void push_node_halo(int row_block, int col_block) {
+    if (region_window == MPI_WIN_NULL) return;
+    if (grid.row_size[row_block] == 0 || grid.col_size[col_block] == 0) return;
+    auto& src = regions[block_region[grid.block_id(row_block, col_block)]];
+    int next_row = grid.next_row_block(row_block);
+    int next_col = grid.next_col_block(col_block);
+    const int dest_rows[] = {row_block, next_row, next_row};
+    const int dest_cols[] = {next_col, col_block, next_col};
+    for (int piece = 0; piece < HALO_PIECE_COUNT; ++piece) {
+        int dest_block = grid.block_id(dest_rows[piece], dest_cols[piece]);
+        int dest_owner = grid.owners[dest_block];
+        if (dest_owner == world_rank || !on_node(dest_owner)) continue;
+        PhaseTimer timer((Phase)(PHASE_HALO_COLUMN + piece));
+        copy_halo_piece(src, node_regions[block_node_region[dest_block]], (HaloPiece)piece);
     }
-    int rule_id = visited_state[reduced_state];
-    if (rule_id >= (int)rule.size()) {
-        return -1;
+}
+
+// the boundaries of every block.
+void start_full_halo_exchange() {
+    for (auto& block: region_blocks) {
+        push_node_halo(block.first, block.second);
     }
-    int choice = rule[rule_id];
-    if (GETBIT(state, choice)) {
-        return -1;
+    barrier_node_window();
+    for (int r = 0; r < grid.row_blocks(); ++r)
+    for (int c = 0; c < grid.col_blocks(); ++c) {
+        start_halo_exchange(r, c);
     }
-    return choice;
-}
-
-bool game_step() {
-    send_state_to_neighbor_vertical();
-    send_state_to_neighbor_horizontal();
-    send_inner();
-    if (std::getenv("DEBUG")) {
-        log << "updating worm position " << std::endl;
-    }
-    int state = -1;
-    for (int i = 0; i < world_size; ++i) {
-        int r = i;
-        int c = (i + world_rank) % world_size;
-        if ((int)row_pos[r] > game.worm.row) continue;
-        if ((int)col_pos[c] > game.worm.col) continue;
-        if ((int)row_pos[r] + (int)row_size[r] <= game.worm.row) continue;
-        if ((int)col_pos[c] + (int)col_size[c] <= game.worm.col) continue;
-        state = regions[i].get_state(game.worm.row - row_pos[r], game.worm.col - col_pos[c]);
-        break;
+}
+
+// must be called before touching the boundary or the ghost cells of a region.
+inline void wait_region_halo(int reg_id) {
+    auto& requests = halo_requests[reg_id];
+    if (requests.empty()) return;
+    PhaseTimer timer(PHASE_HALO_WAIT);
+    MPI_Waitall(requests.size(), requests.data(), MPI_STATUSES_IGNORE);
+    requests.clear();
+}
+
+void wait_halo() {
+    for (size_t i = 0; i < regions.size(); ++i) {
+        wait_region_halo(i);
+    }
+}
+
+WormToken pack_token(unsigned long step_count, bool entered) {
+    WormToken token;
+    token.worm = game.worm;
+    token.iteration_count = game.iteration_count;
+    token.step_count = step_count;
+    token.entered = entered;
+    token.total_visited_state = total_visited_state;
+    std::copy(visited_state, visited_state + (1 << 5), token.visited_state);
+    return token;
+}
+
+void unpack_token(const WormToken& token, unsigned long& step_count, bool& entered) {
+    game.worm = token.worm;
+    game.iteration_count = token.iteration_count;
+    step_count = token.step_count;
+    entered = token.entered;
+    total_visited_state = token.total_visited_state;
+    std::copy(token.visited_state, token.visited_state + (1 << 5), visited_state);
+}
+
+// where the worm must stop next, for a keyframe or a line of --metrics.
+inline unsigned long next_stop_step() {
+    return std::min(next_keyframe_step, next_metrics_step);
+}
+
+// Steps the worm inside the region that currently holds it, until it leaves the region,
+// dies or there is no iteration left. Returns true if the worm has left the region,
+// in which case the new owner must still draw the edge from its side. Stats is whether the
+// run stats are counted (--metrics), so the loop without them does not test it.
+template<bool Stats>
+bool step_locally(unsigned long& step_count, bool entered) {
+    PhaseTimer timer(PHASE_STEP);
+    int row_block = row_block_of(game.worm.row), col_block = col_block_of(game.worm.col);
+    int reg_id = block_region[grid.block_id(row_block, col_block)];
+    auto& reg = regions[reg_id];
+    int top = grid.row_pos[row_block];
+    int left = grid.col_pos[col_block];
+    int row = game.worm.row - top;
+    int col = game.worm.col - left;
+    // when the region is its own neighbour, its ghost cells are copies of itself
+    // and must be kept up to date while the worm moves.
+    bool self_left = grid.next_col_block(col_block) == col_block;
+    bool self_up = grid.next_row_block(row_block) == row_block;
+    int h = reg.get_height(), w = reg.get_width();
+    if (trajectory) trajectory->sync(step_count, game.worm.row, game.worm.col, game.worm.dir);
+    if (entered) {
+        wait_region_halo(reg_id);
+        reg.upd_state(row, col, opposite_dir[game.worm.dir]);
     }
     
-    GameInfo old_game = game;
-    MPI_Send(&state, 1, MPI_INT, 0, 0, MPI_COMM_WORLD);
-    if (world_rank == 0) {
-        for (int other = 0; other < world_size; ++other) {
-            MPI_Recv(&state, 1, MPI_INT, other, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-            if (state == -1) continue;
-            int rotated_state = rotate_right(state, 6, game.worm.dir);
-            int new_dir = query_state(rotated_state);
-            if (new_dir == -1) {
-                game.worm.dir = -1;
-            } else {
-                game.worm.dir += new_dir;
-                if (game.worm.dir >= 6) game.worm.dir -= 6;
-                game.worm.row += dr[game.worm.dir];
-                game.worm.col += dc[game.worm.dir];
-                if (game.worm.row < 0) game.worm.row += game.height;
-                if (game.worm.row >= (int)game.height) game.worm.row -= game.height;
-                if (game.worm.col < 0) game.worm.col += game.width;
-                if (game.worm.col >= (int)game.width) game.worm.col -= game.width;
+    while (game.iteration_count > 0 && step_count < next_stop_step()) {
+        // inside the region nothing is read from the ghost cells nor written to the
+        // boundary, so the halo of this region may still be in flight.
+        if (row < 1 || col < 1 || row + 1 >= h || col + 1 >= w) {
+            wait_region_halo(reg_id);
+            if (col == 0 && self_left) {
+                reg.set(row, -1, reg(row, w - 1));
+                if (row > 0) reg.set(row - 1, -1, reg(row - 1, w - 1));
+            }
+            if (row == 0 && self_up) {
+                reg.set(-1, col, reg(h - 1, col));
+                if (col > 0) reg.set(-1, col - 1, reg(h - 1, col - 1));
             }
-            if (std::getenv("DEBUG")) {
-                log << "state " << state << "; dir = " << new_dir << std::endl;
-                log << "worm pos: " << game.worm.row << ' ' << game.worm.col << std::endl;
+            if (row == 0 && col == 0 && self_left && self_up) {
+                reg.set(-1, -1, reg(h - 1, w - 1));
             }
         }
+        int state = reg.get_state(row, col);
+        int new_dir = transitions.next(state, game.worm.dir, rule, visited_state, total_visited_state);
+        if (Stats) run_stats.read(game.worm.row, game.worm.col, game.worm.dir, state, first_visit(reg_id, row, col));
+        if (new_dir == -1) {
+            if (Stats) run_stats.death(step_count);
+            game.worm.dir = -1;
+            return false;
+        }
+        int turn = new_dir - game.worm.dir;
+        if (turn < 0) turn += 6;
+        game.worm.dir = new_dir;
+        --game.iteration_count;
+        ++step_count;
+        if (Stats) run_stats.step();
+        
+        reg.upd_state(row, col, game.worm.dir);
+        row += dr[game.worm.dir];
+        col += dc[game.worm.dir];
+        // wrapping around the board is also leaving the region, since the ghost cells
+        // of this region must be refreshed before being read again.
+        if (row < 0 || row >= h || col < 0 || col >= w) {
+            game.worm.row = (top + row + game.height) % game.height;
+            game.worm.col = (left + col + game.width) % game.width;
+            if (trajectory) trajectory->record(turn, game.worm.row, game.worm.col, game.worm.dir);
+            return true;
+        }
+        reg.upd_state(row, col, opposite_dir[game.worm.dir]);
+        game.worm.row = top + row;
+        game.worm.col = left + col;
+        if (trajectory) trajectory->record(turn, game.worm.row, game.worm.col, game.worm.dir);
     }
-    
-    MPI_Bcast(&game, sizeof(GameInfo), MPI_BYTE, 0, MPI_COMM_WORLD);
-    if (game.worm.dir == -1) return false;
-    
-    for (int i = 0; i < world_size; ++i) {
-        int r = i;
-        int c = (i + world_rank) % world_size;
-        if ((int)row_pos[r] > game.worm.row) continue;
-        if ((int)col_pos[c] > game.worm.col) continue;
-        if ((int)(row_pos[r] + row_size[r]) <= game.worm.row) continue;
-        if ((int)(col_pos[c] + col_size[c]) <= game.worm.col) continue;
-        regions[i].upd_state(game.worm.row - row_pos[r], game.worm.col - col_pos[c], opposite_dir[game.worm.dir]);
-        break;
+    return false;
+}
+
+// Draws the edge the worm came in by, on the side of its new region, when it has not been
+// done yet. The board is then complete, as after step_count steps.
+void finish_entry(bool& entered) {
+    if (entered && world_rank == owner_of(game.worm.row, game.worm.col)) {
+        int row, col;
+        int reg_id = region_of(game.worm.row, game.worm.col, row, col);
+        wait_region_halo(reg_id);
+        regions[reg_id].upd_state(row, col, opposite_dir[game.worm.dir]);
+    }
+    // every process knows about it, since the token was broadcast.
+    entered = false;
+}
+
+void record_keyframe(unsigned long step_count, size_t offset) {
+    if (world_rank == 0) {
+        keyframe_index << step_count << ' ' << offset << std::endl;
+    }
+    ++keyframe_count;
+    next_keyframe_step = step_count + options.keyframe_interval;
+}
+
+// The board after step_count steps, written as the next checkpoint of the keyframe file.
+void write_keyframe(unsigned long step_count) {
+    size_t offset = keyframe_count * checkpoint_size(game.height, game.width);
+    write_checkpoint_regions(options.keyframe_file, offset);
+    record_keyframe(step_count, offset);
+}
+
+void write_keyframe(const SequentialGame& seq) {
+    size_t offset = keyframe_count * checkpoint_size(game.height, game.width);
+    CheckpointHeader header = make_checkpoint_header(seq.game, seq.rule, seq.visited_state, seq.total_visited_state);
+    safe_assert(write_checkpoint(options.keyframe_file, header, seq.cells, offset),
+                "Cannot write file " << std::quoted(options.keyframe_file));
+    record_keyframe(seq.steps_done, offset);
+}
+
+void open_keyframe_index() {
+    if (world_rank != 0) return;
+    std::string filename = options.keyframe_file + ".index";
+    keyframe_index.open(filename, std::ios::trunc);
+    safe_assert(keyframe_index, "Cannot write file " << std::quoted(filename));
+}
+
+void add_run_stats_op(void* in, void* inout, int* len, MPI_Datatype*) {
+    for (int i = 0; i < *len; ++i) {
+        add_run_stats(((RunStats*)inout)[i], ((const RunStats*)in)[i]);
+    }
+}
+
+void open_metrics() {
+    run_stats = RunStats();
+    region_visited.assign(regions.size(), VisitedCells());
+    for (size_t i = 0; i < regions.size(); ++i) {
+        region_visited[i].reset(regions[i].get_height(), regions[i].get_width());
+    }
+    metrics_start = MPI_Wtime();
+    next_metrics_step = options.metrics_interval;
+    if (run_stats_op == MPI_OP_NULL) {
+        MPI_Type_contiguous(sizeof(RunStats), MPI_BYTE, &run_stats_type);
+        MPI_Type_commit(&run_stats_type);
+        MPI_Op_create(add_run_stats_op, 1, &run_stats_op);
+    }
+    if (world_rank != 0) return;
+    metrics_out.open(options.metrics_file, std::ios::trunc);
+    safe_assert(metrics_out, "Cannot write file " << std::quoted(options.metrics_file));
+    write_run_stats_header(metrics_out);
+}
+
+// The line of the time series after step_count steps, with the stats of every process put
+// together in one reduction when `collective` (then every process must call it), or else
+// with the ones of rank 0.
+void write_metrics(unsigned long step_count, bool collective) {
+    RunStats total = run_stats;
+    if (collective) {
+        PhaseTimer timer(PHASE_GATHER, sizeof(RunStats));
+        MPI_Reduce(&run_stats, &total, 1, run_stats_type, run_stats_op, 0, MPI_COMM_WORLD);
+    }
+    if (world_rank == 0) write_run_stats(metrics_out, step_count, MPI_Wtime() - metrics_start, total);
+    last_metrics_step = step_count;
+    next_metrics_step = step_count + options.metrics_interval;
+}
+
+// the last line, when the run ends.
+void finish_metrics(unsigned long step_count, bool collective) {
+    if (options.metrics_file.empty() || step_count == last_metrics_step) return;
+    write_metrics(step_count, collective);
+}
+
+// One round of the game: the rank holding the worm's cell runs it as far as it can,
+// then hands the worm (as a token) to the others. Returns false when the game is over.
+bool game_step(unsigned long& step_count, bool& entered) {
+    int row_block = row_block_of(game.worm.row);
+    int col_block = col_block_of(game.worm.col);
+    int owner = grid.owner(row_block, col_block);
+    if (LOG_ENABLED(LOG_DEBUG)) {
+        log << "worm at " << game.worm.row << ' ' << game.worm.col << " is owned by " << owner << std::endl;
     }
     
-    for (int i = 0; i < world_size; ++i) {
-        int r = i;
-        int c = (i + world_rank) % world_size;
-        if ((int)row_pos[r] > old_game.worm.row) continue;
-        if ((int)col_pos[c] > old_game.worm.col) continue;
-        if ((int)(row_pos[r] + row_size[r]) <= old_game.worm.row) continue;
-        if ((int)(col_pos[c] + col_size[c]) <= old_game.worm.col) continue;
-        regions[i].upd_state(old_game.worm.row - row_pos[r], old_game.worm.col - col_pos[c], game.worm.dir);
-        break;
+    WormToken token;
+    if (world_rank == owner) {
+        bool left = options.metrics_file.empty() ? step_locally<false>(step_count, entered)
+                                                  : step_locally<true>(step_count, entered);
+        token = pack_token(step_count, left);
+        push_node_halo(row_block, col_block);
+        sync_node_window();
     }
+    {
+        PhaseTimer timer(PHASE_TOKEN, world_rank == owner ? sizeof(WormToken) : 0);
+        MPI_Bcast(&token, sizeof(WormToken), MPI_BYTE, owner, MPI_COMM_WORLD);
+    }
+    sync_node_window();
+    unpack_token(token, step_count, entered);
+    // only the block the worm was in has changed, so only its boundary must be sent.
+    wait_halo();
+    start_halo_exchange(row_block, col_block);
     
+    if (game.worm.dir == -1) return false;
+    if (game.iteration_count == 0) {
+        // the last step might cross the border, so the edge must be finished on the other side.
+        finish_entry(entered);
+        return false;
+    }
     return true;
 }
 
-void combine_states() {
-    std::vector<char> board_data;
-    board_data.reserve(total_area);
+// A move of a worm in a step of run_worms: the state it reads, then the direction it takes,
+// -1 when it dies or stay_dir when another worm takes the same edge.
+struct WormMove {
+    int index;
+    int state;
+    int dir;
+};
+const int stay_dir = -2;
+
+// A worm sent to every process by step_worms_together, with the state it reads.
+struct WormItem {
+    int index;
+    int state;
+    WormState worm;
+};
+
+// the items of every process, one process after the other.
+template<typename T>
+std::vector<T> allgather_items(const std::vector<T>& items) {
+    int bytes = items.size() * sizeof(T);
+    std::vector<int> counts(world_size), displs(world_size);
+    MPI_Allgather(&bytes, 1, MPI_INT, counts.data(), 1, MPI_INT, MPI_COMM_WORLD);
+    for (int i = 1; i < world_size; ++i) displs[i] = displs[i - 1] + counts[i - 1];
+    std::vector<T> res((displs.back() + counts.back()) / sizeof(T));
+    MPI_Allgatherv(items.data(), bytes, MPI_BYTE, res.data(), counts.data(), displs.data(), MPI_BYTE, MPI_COMM_WORLD);
+    return res;
+}
+
+// the same, only on rank 0; the others get nothing.
+template<typename T>
+std::vector<T> gather_items(const std::vector<T>& items) {
+    int bytes = items.size() * sizeof(T);
+    std::vector<int> counts(world_size), displs(world_size);
+    MPI_Gather(&bytes, 1, MPI_INT, counts.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
+    for (int i = 1; i < world_size; ++i) displs[i] = displs[i - 1] + counts[i - 1];
+    std::vector<T> res(world_rank == 0 ? (displs.back() + counts.back()) / sizeof(T) : 0);
+    MPI_Gatherv(items.data(), bytes, MPI_BYTE, res.data(), counts.data(), displs.data(), MPI_BYTE, 0, MPI_COMM_WORLD);
+    return res;
+}
+
+inline bool is_alive(int index) {
+    return worms[index].worm.dir >= 0;
+}
+
+// the worms in the regions of this process. A process only knows where the worms of the
+// others were when they were last sent, but they have not left their region since.
+std::vector<int> owned_worms() {
+    std::vector<int> res;
+    for (int i = 0; i < (int)worms.size(); ++i) {
+        if (owner_of(worms[i].worm.row, worms[i].worm.col) == world_rank) res.push_back(i);
+    }
+    return res;
+}
+
+// How many steps the worm can do without reading a ghost cell nor drawing an edge in the
+// last row or column of its region (which are the ghost cells of others), 0 if none.
+int free_steps(const Worm& worm) {
+    int row_block = row_block_of(worm.row), col_block = col_block_of(worm.col);
+    int row = worm.row - grid.row_pos[row_block], col = worm.col - grid.col_pos[col_block];
+    int margin = std::min({row - 1, col - 1, (int)grid.row_size[row_block] - 2 - row, (int)grid.col_size[col_block] - 2 - col});
+    return std::max(margin + 1, 0);
+}
+
+int read_worm_state(const Worm& worm) {
+    int row, col;
+    int reg_id = region_of(worm.row, worm.col, row, col);
+    return regions[reg_id].get_state(row, col);
+}
+
+// the new direction of the worm for the state it reads, binding the state when it is new.
+inline int worm_next(int index, int state) {
+    WormState& w = worms[index];
+    if (own_bindings) {
+        return worm_transitions[index].next(state, w.worm.dir, rule, w.visited_state, w.total_visited_state);
+    }
+    return transitions.next(state, w.worm.dir, rule, visited_state, total_visited_state);
+}
+
+// the shared state worm_next would bind for the worm, -1 if there is none. The processes
+// must bind them in the same order, the one of the worms.
+inline int unbound_state(int index, int state) {
+    if (own_bindings) return -1;
+    int reduced_state = reduce_state(rotate_right(state, 6, worms[index].worm.dir));
+    return visited_state[reduced_state] == -1 ? reduced_state : -1;
+}
+
+// the cell and the bit the edge from (row, col) in the direction is kept in.
+inline void edge_cell(int row, int col, int dir, int& edge_row, int& edge_col, int& bit) {
+    if (dir < 3) {
+        edge_row = row;
+        edge_col = col;
+        bit = dir;
+        return;
+    }
+    edge_row = (row + dr[dir] + game.height) % game.height;
+    edge_col = (col + dc[dir] + game.width) % game.width;
+    bit = opposite_dir[dir];
+}
+
+// The moves are in the order of the worms. When several worms take the same edge, the
+// first one draws it and the others stay where they are for this step.
+void resolve_conflicts(std::vector<WormMove>& moves) {
+    std::vector<std::pair<uint64_t, size_t>> edges;
+    for (size_t i = 0; i < moves.size(); ++i) {
+        if (moves[i].dir < 0) continue;
+        const Worm& worm = worms[moves[i].index].worm;
+        int row, col, bit;
+        edge_cell(worm.row, worm.col, moves[i].dir, row, col, bit);
+        edges.emplace_back(((uint64_t)row * game.width + col) * 3 + bit, i);
+    }
+    std::sort(edges.begin(), edges.end());
+    for (size_t i = 1; i < edges.size(); ++i) {
+        if (edges[i].first == edges[i - 1].first) moves[edges[i].second].dir = stay_dir;
+    }
+}
+
+// Sets the bit of the cell in every copy of it this process holds: in its region, and in
+// the ghost cells of the regions below and to the right of it.
+void draw_edge(int row, int col, int bit) {
+    for (size_t i = 0; i < regions.size(); ++i) {
+        auto& reg = regions[i];
+        if (reg.area() == 0) continue;
+        size_t top = grid.row_pos[region_blocks[i].first], left = grid.col_pos[region_blocks[i].second];
+        int local_row = row - top, local_col = col - left;
+        bool in_rows = 0 <= local_row && local_row < reg.get_height();
+        bool in_cols = 0 <= local_col && local_col < reg.get_width();
+        bool ghost_row = row == (int)((top + game.height - 1) % game.height);
+        bool ghost_col = col == (int)((left + game.width - 1) % game.width);
+        if (in_rows && in_cols) {
+            phase_stats[PHASE_CELL_UPDATE].count++;
+            reg.set(local_row, local_col, reg(local_row, local_col) | 1 << bit);
+        }
+        if (ghost_row && in_cols) reg.set(-1, local_col, reg(-1, local_col) | 1 << bit);
+        if (ghost_col && in_rows) reg.set(local_row, -1, reg(local_row, -1) | 1 << bit);
+        if (ghost_row && ghost_col) reg.set(-1, -1, reg(-1, -1) | 1 << bit);
+    }
+}
+
+// the run stats of a move of a worm of this process, before it is applied, with --metrics.
+inline void count_move(const WormMove& move, unsigned long step_count) {
+    const Worm& worm = worms[move.index].worm;
+    int row, col;
+    int reg_id = region_of(worm.row, worm.col, row, col);
+    run_stats.read(worm.row, worm.col, worm.dir, move.state, first_visit(reg_id, row, col));
+    if (move.dir >= 0) {
+        run_stats.step();
+    } else if (move.dir == -1) {
+        run_stats.death(step_count);
+    }
+}
+
+// Draws the edge of the move and moves the worm. A worm of this process far from the border
+// of its region only touches the region, the others may touch any copy of the cells.
+// Returns whether the worm has moved.
+bool apply_move(const WormMove& move, bool in_region) {
+    Worm& worm = worms[move.index].worm;
+    if (move.dir == stay_dir) return false;
+    if (move.dir == -1) {
+        worm.dir = -1;
+        return false;
+    }
+    if (in_region) {
+        int row, col;
+        int reg_id = region_of(worm.row, worm.col, row, col);
+        regions[reg_id].upd_state(row, col, move.dir);
+    } else {
+        int row, col, bit;
+        edge_cell(worm.row, worm.col, move.dir, row, col, bit);
+        draw_edge(row, col, bit);
+    }
+    worm.dir = move.dir;
+    worm.row = (worm.row + dr[move.dir] + game.height) % game.height;
+    worm.col = (worm.col + dc[move.dir] + game.width) % game.width;
+    return true;
+}
+
+// Steps the worms `count` times, each process moving its own worms without waiting for the
+// others, since none of them can reach a ghost cell before (see free_steps). With shared
+// bindings, a process stops before a step where one of its worms meets a state that is not
+// bound yet; the states of the earliest such step are bound by every process, then they go on.
+void step_worms_independently(unsigned long count, unsigned long& step_count) {
+    std::vector<int> mine = owned_worms();
+    const bool stats = !options.metrics_file.empty();
+    std::vector<unsigned char> moved(count, 0);
+    std::vector<WormMove> moves;
+    unsigned long done = 0;
+    while (true) {
+        // (worm, state) to bind.
+        std::vector<std::pair<int, int>> unbound;
+        {
+            PhaseTimer timer(PHASE_STEP);
+            for (; done < count; ++done) {
+                moves.clear();
+                for (int i: mine) {
+                    if (!is_alive(i)) continue;
+                    int state = read_worm_state(worms[i].worm);
+                    int new_state = unbound_state(i, state);
+                    if (new_state != -1) unbound.emplace_back(i, new_state);
+                    moves.push_back({i, state, 0});
+                }
+                if (!unbound.empty()) break;
+                for (auto& move: moves) move.dir = worm_next(move.index, move.state);
+                resolve_conflicts(moves);
+                for (auto& move: moves) {
+                    if (stats) count_move(move, step_count + done);
+                    moved[done] |= apply_move(move, true);
+                }
+            }
+        }
+        unsigned long first_stop;
+        MPI_Allreduce(&done, &first_stop, 1, MPI_UNSIGNED_LONG, MPI_MIN, MPI_COMM_WORLD);
+        if (first_stop == count) break;
+        if (done != first_stop) unbound.clear();
+        std::vector<std::pair<int, int>> all_unbound;
+        {
+            PhaseTimer timer(PHASE_TOKEN, unbound.size() * sizeof(unbound[0]));
+            all_unbound = allgather_items(unbound);
+        }
+        std::sort(all_unbound.begin(), all_unbound.end());
+        for (auto& item: all_unbound) {
+            if (visited_state[item.second] == -1) visited_state[item.second] = total_visited_state++;
+        }
+    }
+    MPI_Allreduce(MPI_IN_PLACE, moved.data(), count, MPI_UNSIGNED_CHAR, MPI_MAX, MPI_COMM_WORLD);
+    step_count += std::count(moved.begin(), moved.end(), 1);
+    game.iteration_count -= count;
+}
+
+// One step of the worms while some of them may reach a ghost cell. These worms, the ones
+// next to them (which may take the same edge) and, with shared bindings, the ones meeting a
+// new state are sent to every process, which all move them the same way and draw their
+// edges in every copy of the cells. The other worms are moved by their owner only.
+// Returns whether a worm of this process has moved.
+bool step_worms_together(unsigned long step_count) {
+    std::vector<int> mine = owned_worms();
+    std::set<std::pair<int, int>> near_cells;
+    for (int i: mine) {
+        if (is_alive(i) && free_steps(worms[i].worm) == 0) near_cells.emplace(worms[i].worm.row, worms[i].worm.col);
+    }
+    std::vector<WormItem> sent;
+    std::vector<WormMove> moves;
     {
-        for (auto& reg: regions) {
-            for (int r = 0; r < reg.get_height(); ++r)
-            for (int c = 0; c < reg.get_width(); ++c) {
-                board_data.push_back(reg(r, c));
+        PhaseTimer timer(PHASE_STEP);
+        for (int i: mine) {
+            if (!is_alive(i)) continue;
+            const Worm& worm = worms[i].worm;
+            int state = read_worm_state(worm);
+            bool send = unbound_state(i, state) != -1;
+            for (int d = 0; !send && d < 9; ++d) {
+                int row = (worm.row + d / 3 - 1 + game.height) % game.height;
+                int col = (worm.col + d % 3 - 1 + game.width) % game.width;
+                send = near_cells.count({row, col});
             }
+            if (send) {
+                sent.push_back({i, state, worms[i]});
+            } else {
+                moves.push_back({i, state, 0});
+            }
+        }
+    }
+    std::vector<WormItem> received;
+    {
+        PhaseTimer timer(PHASE_TOKEN, sent.size() * sizeof(WormItem));
+        received = allgather_items(sent);
+    }
+    PhaseTimer timer(PHASE_STEP);
+    // the moves of the worms sent are the same in every process, whatever the others are.
+    std::vector<bool> shared(worms.size());
+    for (auto& item: received) {
+        worms[item.index] = item.worm;
+        shared[item.index] = true;
+        moves.push_back({item.index, item.state, 0});
+    }
+    std::sort(moves.begin(), moves.end(), [](const WormMove& a, const WormMove& b) {
+        return a.index < b.index;
+    });
+    for (auto& move: moves) move.dir = worm_next(move.index, move.state);
+    resolve_conflicts(moves);
+    const bool stats = !options.metrics_file.empty();
+    bool moved = false;
+    for (auto& move: moves) {
+        const Worm& worm = worms[move.index].worm;
+        bool owned = owner_of(worm.row, worm.col) == world_rank;
+        if (owned && stats) count_move(move, step_count);
+        moved |= apply_move(move, !shared[move.index]) && owned;
+    }
+    --game.iteration_count;
+    return moved;
+}
+
+// every process gets the worms of the others as they are.
+void gather_worms() {
+    std::vector<WormItem> items;
+    for (int i: owned_worms()) items.push_back({i, 0, worms[i]});
+    for (auto& item: allgather_items(items)) worms[item.index] = item.worm;
+}
+
+// The game with a worm list: at each step, every worm alive reads its state on the board
+// before the step and moves. The processes step the worms of their regions on their own as
+// long as none of them can reach another region, and together otherwise.
+void run_worms(unsigned long& step_count) {
+    worm_transitions.assign(worms.size(), TransitionTable());
+    wait_halo();
+    bool moved = false;
+    while (true) {
+        // the steps every worm can do on its own, whether a worm is alive, and whether the
+        // last step of step_worms_together has moved one, the negated ones being maximums.
+        long local[3] = {LONG_MAX, 0, -(long)moved};
+        for (int i: owned_worms()) {
+            if (!is_alive(i)) continue;
+            local[0] = std::min(local[0], (long)free_steps(worms[i].worm));
+            local[1] = -1;
+        }
+        long global[3];
+        MPI_Allreduce(local, global, 3, MPI_LONG, MPI_MIN, MPI_COMM_WORLD);
+        if (global[2] < 0) ++step_count;
+        moved = false;
+        if (global[1] == 0 || game.iteration_count == 0) break;
+        if (step_count >= next_metrics_step) write_metrics(step_count, true);
+        unsigned long count = std::min({(unsigned long)global[0], game.iteration_count, next_metrics_step - step_count});
+        if (LOG_ENABLED(LOG_DEBUG)) {
+            log << "worms step " << (count > 0 ? count : 1) << (count > 0 ? " on their own" : " together") << std::endl;
+        }
+        if (count > 0) {
+            step_worms_independently(count, step_count);
+        } else {
+            moved = step_worms_together(step_count);
+        }
+    }
+    gather_worms();
+}
+
+// the cells of the regions of another process of the node, as its region_cells would give them.
+std::vector<char> node_region_cells(int other) {
+    std::vector<char> res;
+    for (auto& block: grid.blocks_of(other)) {
+        auto& reg = node_regions[block_node_region[grid.block_id(block.first, block.second)]];
+        size_t offset = res.size();
+        res.resize(offset + reg.area());
+        for (int r = 0; r < reg.get_height(); ++r) {
+            reg.write_row(r, &res[offset + r * reg.get_width()]);
         }
     }
-    if (std::getenv("DEBUG")) {
+    return res;
+}
+
+// the processes of the node of rank 0 do not send their cells, it reads them in the window.
+void combine_states() {
+    bool shared = on_node(0);
+    PhaseTimer timer(PHASE_GATHER, shared ? 0 : total_area);
+    barrier_node_window();
+    std::vector<char> board_data = world_rank == 0 || !shared ? region_cells() : std::vector<char>();
+    // a checkpoint has no ASCII board to start from.
+    if (world_rank == 0 && board_ascii.empty()) {
+        board_ascii.assign(2 * game.height, std::string(2 * game.width, ' '));
+    }
+    if (LOG_ENABLED(LOG_DEBUG)) {
         log << "area = " << total_area << std::endl;
     }
-    MPI_Send(board_data.data(), total_area, MPI_BYTE, 0, 0, MPI_COMM_WORLD);
+    MPI_Request request = MPI_REQUEST_NULL;
+    if (!shared) MPI_Isend(board_data.data(), total_area, MPI_BYTE, 0, 0, MPI_COMM_WORLD, &request);
     if (world_rank == 0) {
         for (int other = 0; other < world_size; ++other) {
+            auto blocks = grid.blocks_of(other);
             int cur_area = 0;
-            for (int reg = 0; reg < world_size; ++reg) {
-                int col_reg = (reg + other) % world_size;
-                cur_area += row_size[reg] * col_size[col_reg];
+            for (auto& block: blocks) {
+                cur_area += grid.row_size[block.first] * grid.col_size[block.second];
             }
-            if (std::getenv("DEBUG")) {
+            if (LOG_ENABLED(LOG_DEBUG)) {
                 log << "Try receive from " << other << "; area = " << cur_area << std::endl;
             }
-            std::vector<char> data(cur_area);
-            MPI_Recv(data.data(), cur_area, MPI_BYTE, other, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            std::vector<char> data;
+            if (other == 0 && shared) {
+                data.swap(board_data);
+            } else if (on_node(other)) {
+                data = node_region_cells(other);
+            } else {
+                data.resize(cur_area);
+                MPI_Recv(data.data(), cur_area, MPI_BYTE, other, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            }
             
-            auto it = data.begin();
-            for (int reg = 0; reg < world_size; ++reg) {
-                int col_reg = (reg + other) % world_size;
-                for (size_t r = 0; r < row_size[reg]; ++r)
-                for (size_t c = 0; c < col_size[col_reg]; ++c) {
-                    int ascii_r = (r + row_pos[reg]) * 2;
-                    int ascii_c = (c + col_pos[col_reg]) * 2;
-                    int cur = *it++;
-                    // std::cout << "cur = " << cur << ' ' << ascii_r << ' ' << ascii_c << ' ' << GETBIT(cur, 2) << std::endl;
-                    board_ascii[ascii_r][ascii_c] = '*';
-                    board_ascii[ascii_r + 1][ascii_c] = GETBIT(cur, 2) ? '|' : ' ';
-                    board_ascii[ascii_r + 1][ascii_c + 1] = GETBIT(cur, 1) ? '\\' : ' ';
-                    board_ascii[ascii_r][ascii_c + 1] = GETBIT(cur, 0) ? '=' : ' ';
+            const char* it = data.data();
+            for (auto& block: blocks) {
+                size_t width = grid.col_size[block.second];
+                for (size_t r = 0; r < grid.row_size[block.first]; ++r) {
+                    int ascii_r = (r + grid.row_pos[block.first]) * 2;
+                    int ascii_c = grid.col_pos[block.second] * 2;
+                    encode_ascii_row(it, width, &board_ascii[ascii_r][ascii_c], &board_ascii[ascii_r + 1][ascii_c]);
+                    it += width;
                 }
             }
-            if (std::getenv("DEBUG")) {
+            if (LOG_ENABLED(LOG_DEBUG)) {
                 log << "received from " << other << ": ";
                 std::cout << data.size() << ": ";
                 for (auto x: data) std::cout << (int)x << ", ";
@@ -413,67 +1411,550 @@ void combine_states() {
             }
         }
     }
+    MPI_Wait(&request, MPI_STATUS_IGNORE);
 }
 
-void print_state() {
-    using std::cout;
-    using std::endl;
-    cout << game.height << ' ' << game.width << endl;
-    cout << game.worm.row << ' ' << game.worm.col << ' ' << game.worm.dir << endl;
-    cout << rule.size() << endl;
-    for (auto x: rule) cout << x << ' ';
-    cout << endl;
-    std::vector<int> state(total_visited_state);
-    for (int i = 0; i < (1 << 5); ++i) {
-        if (visited_state[i] == -1) continue;
-        state[visited_state[i]] = i;
-    }
-    cout << total_visited_state << endl;
-    for (auto x: state) cout << x << ' ';
-    cout << endl;
+// everything but the board.
+void print_header(std::ostream& out) {
+    write_state_header(out, game, rule, visited_state, total_visited_state,
+                       worm_list_input ? worms : std::vector<WormState>(), own_bindings);
+}
+
+void print_state(std::ostream& out = std::cout) {
+    print_header(out);
     for (auto& line: board_ascii) {
-        cout << line << endl;
+        out << line << std::endl;
+    }
+}
+
+// --delta: the header, then `delta <count>` and the cells that are not the same as in the
+// state file, one `<row> <col> <cell>` per line in the order of the board, where the cell
+// has the bits of the edges as in ChessBoardRegion.
+void print_delta(std::ostream& out, const std::vector<DeltaCell>& changed) {
+    print_header(out);
+    out << "delta " << changed.size() << '\n';
+    for (auto& cell: changed) {
+        out << cell.row << ' ' << cell.col << ' ' << cell.cell << '\n';
+    }
+    out.flush();
+}
+
+// every process compares its regions with initial_cells, and rank 0 prints what changed.
+void gather_delta(std::ostream& out) {
+    std::vector<char> board_data = region_cells();
+    std::vector<DeltaCell> changed;
+    size_t i = 0;
+    for (size_t reg = 0; reg < regions.size(); ++reg) {
+        int top = grid.row_pos[region_blocks[reg].first], left = grid.col_pos[region_blocks[reg].second];
+        for (int r = 0; r < regions[reg].get_height(); ++r)
+        for (int c = 0; c < regions[reg].get_width(); ++c, ++i) {
+            if (board_data[i] != initial_cells[i]) changed.push_back({top + r, left + c, board_data[i]});
+        }
+    }
+    PhaseTimer timer(PHASE_GATHER, changed.size() * sizeof(DeltaCell));
+    std::vector<DeltaCell> all = gather_items(changed);
+    if (world_rank == 0) {
+        std::sort(all.begin(), all.end(), [](const DeltaCell& a, const DeltaCell& b) {
+            return a.row != b.row ? a.row < b.row : a.col < b.col;
+        });
+        print_delta(out, all);
+    }
+}
+
+// every process must call it, the summary is printed by rank 0 to stderr.
+void report_phase_stats() {
+    if (options.stats.empty()) return;
+    std::vector<PhaseStats> all_stats(world_rank == 0 ? world_size * PHASE_COUNT : 0);
+    MPI_Gather(phase_stats, sizeof(phase_stats), MPI_BYTE,
+               all_stats.data(), sizeof(phase_stats), MPI_BYTE, 0, MPI_COMM_WORLD);
+    long rss_kb = max_rss_kb();
+    std::vector<long> all_rss_kb(world_rank == 0 ? world_size : 0);
+    MPI_Gather(&rss_kb, 1, MPI_LONG, all_rss_kb.data(), 1, MPI_LONG, 0, MPI_COMM_WORLD);
+    if (world_rank == 0) {
+        print_phase_stats(std::cerr, all_stats.data(), all_rss_kb.data(), world_size, options.stats == "json");
     }
 }
 
+// the board of the state file, for the runs in one process.
+void load_board(SequentialGame& seq) {
+    if (!checkpoint_input) {
+        seq.read_board(board_ascii);
+        return;
+    }
+    safe_assert(read_checkpoint_cells(options.state_file, seq.cells), "Cannot read the cells of the checkpoint.");
+}
+
+void run_sequential() {
+    SequentialGame seq(game, rule, visited_state, total_visited_state);
+    load_board(seq);
+    if (options.delta) initial_cells = seq.cells;
+    if (!options.trajectory_file.empty()) {
+        trajectory = std::make_unique<TrajectoryLog>(options.trajectory_file);
+        seq.trajectory = trajectory.get();
+    }
+    if (!options.keyframe_file.empty()) {
+        open_keyframe_index();
+        write_keyframe(seq);
+    }
+    if (!options.metrics_file.empty()) {
+        open_metrics();
+        seq.run_stats = &run_stats;
+    }
+    // the worm stops at every keyframe and every line of the metrics, then goes on.
+    unsigned long iteration_count = seq.game.iteration_count;
+    while (true) {
+        unsigned long stop = next_stop_step();
+        seq.game.iteration_count = std::min(iteration_count, stop - seq.steps_done);
+        iteration_count -= seq.game.iteration_count;
+        seq.run();
+        iteration_count += seq.game.iteration_count;
+        if (seq.game.worm.dir == -1 || seq.steps_done != stop) break;
+        if (stop == next_keyframe_step) write_keyframe(seq);
+        if (stop == next_metrics_step) write_metrics(stop, false);
+        if (iteration_count == 0) break;
+    }
+    seq.game.iteration_count = iteration_count;
+    unsigned long step_count = seq.steps_done;
+    finish_metrics(step_count, false);
+    if (trajectory) {
+        trajectory->end(step_count, seq.game.worm.row, seq.game.worm.col, seq.game.worm.dir);
+        safe_assert(trajectory->finish(), "Cannot write file " << std::quoted(options.trajectory_file));
+    }
+    game = seq.game;
+    total_visited_state = seq.total_visited_state;
+    std::copy(seq.visited_state, seq.visited_state + (1 << 5), visited_state);
+    if (!options.checkpoint_file.empty()) {
+        CheckpointHeader header = make_checkpoint_header(game, rule, visited_state, total_visited_state);
+        safe_assert(write_checkpoint(options.checkpoint_file, header, seq.cells),
+                    "Cannot write file " << std::quoted(options.checkpoint_file));
+    } else if (options.delta) {
+        std::vector<DeltaCell> changed;
+        for (size_t r = 0; r < game.height; ++r)
+        for (size_t c = 0; c < game.width; ++c) {
+            size_t i = r * game.width + c;
+            if (seq.cells[i] != initial_cells[i]) changed.push_back({(int)r, (int)c, seq.cells[i]});
+        }
+        print_delta(std::cout, changed);
+    } else {
+        if (board_ascii.empty()) {
+            board_ascii.assign(2 * game.height, std::string(2 * game.width, ' '));
+        }
+        seq.write_board(board_ascii);
+        print_state();
+    }
+    std::cout << "Stepped iterations: " << step_count << std::endl;
+}
+
+void run_sparse() {
+    safe_assert(!checkpoint_input, "--sparse and --infinite need an ASCII state file.");
+    SparseGame sparse(game, options.infinite, rule, visited_state, total_visited_state);
+    sparse.read_board(board_ascii);
+    sparse.fast_forward = options.fast_forward;
+    if (!options.trajectory_file.empty()) {
+        trajectory = std::make_unique<TrajectoryLog>(options.trajectory_file);
+        sparse.trajectory = trajectory.get();
+    }
+    unsigned long step_count = sparse.run();
+    if (trajectory) {
+        trajectory->end(step_count, sparse.row, sparse.col, sparse.game.worm.dir);
+        safe_assert(trajectory->finish(), "Cannot write file " << std::quoted(options.trajectory_file));
+    }
+    if (LOG_ENABLED(LOG_DEBUG)) {
+        log << "tiles: " << sparse.tile_count() << "; fast-forwarded steps: "
+            << sparse.steps_skipped << std::endl;
+    }
+    game.worm.dir = sparse.game.worm.dir;
+    total_visited_state = sparse.total_visited_state;
+    std::copy(sparse.visited_state, sparse.visited_state + (1 << 5), visited_state);
+
+    int64_t top = 0, left = 0, bottom = game.height - 1, right = game.width - 1;
+    if (options.infinite) {
+        // the smallest box holding the board of the state file, every edge and the worm.
+        int64_t edge_top, edge_left, edge_bottom, edge_right;
+        if (sparse.bounds(edge_top, edge_left, edge_bottom, edge_right)) {
+            top = std::min(top, edge_top);
+            left = std::min(left, edge_left);
+            bottom = std::max(bottom, edge_bottom);
+            right = std::max(right, edge_right);
+        }
+        top = std::min(top, sparse.row);
+        left = std::min(left, sparse.col);
+        bottom = std::max(bottom, sparse.row);
+        right = std::max(right, sparse.col);
+        game.height = bottom - top + 1;
+        game.width = right - left + 1;
+        board_ascii.assign(2 * game.height, std::string(2 * game.width, ' '));
+    }
+    sparse.write_board(board_ascii, top, left, game.height, game.width);
+    game.worm.row = sparse.row - top;
+    game.worm.col = sparse.col - left;
+    print_state();
+    if (options.infinite) {
+        std::cout << "Initial board at: " << -top << ' ' << -left << std::endl;
+    }
+    std::cout << "Stepped iterations: " << step_count << std::endl;
+}
+
+// The game of the state file parsed by rank 0 (see parse_state), run on the regions of
+// every process. Rank 0 prints the result to out. Returns the error, the same on every
+// process, when the board cannot be read; nothing is printed then.
+std::string run_distributed(std::ostream& out) {
+    // broadcasting some info
+    MPI_Bcast(&game, sizeof(GameInfo), MPI_BYTE, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&checkpoint_input, sizeof(bool), MPI_BYTE, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&board_offset, sizeof(size_t), MPI_BYTE, 0, MPI_COMM_WORLD);
+    if (LOG_ENABLED(LOG_DEBUG)) {
+        log << "Recived size: " << game.width << ' ' << game.height << "; iter count: " << game.iteration_count << std::endl;
+    }
+    broadcast_rule();
+    if (worm_list_input) broadcast_worms();
+
+    divide_regions();
+    std::string error = checkpoint_input ? read_checkpoint_regions() : divide_states();
+    if (!error.empty()) return error;
+    if (options.delta) initial_cells = region_cells();
+    build_halo_types();
+    start_full_halo_exchange();
+    // every process records the steps it does in its own file.
+    if (!options.trajectory_file.empty()) {
+        trajectory = std::make_unique<TrajectoryLog>(options.trajectory_file + "." + std::to_string(world_rank));
+    }
+    unsigned long step_count = 0;
+    bool entered = false;
+    if (!options.keyframe_file.empty()) {
+        open_keyframe_index();
+        write_keyframe(0);
+    }
+    if (!options.metrics_file.empty()) open_metrics();
+    if (worm_list_input) {
+        run_worms(step_count);
+    } else if (game.iteration_count > 0) {
+        // the worm stops at every keyframe and every line of the metrics (see step_locally),
+        // then goes on.
+        while (game_step(step_count, entered)) {
+            if (step_count == next_keyframe_step) {
+                finish_entry(entered);
+                write_keyframe(step_count);
+            }
+            if (step_count == next_metrics_step) write_metrics(step_count, true);
+        }
+        // a run that ends on a keyframe step writes it too, as run_sequential does.
+        if (step_count == next_keyframe_step && game.worm.dir != -1) {
+            finish_entry(entered);
+            write_keyframe(step_count);
+        }
+    }
+    finish_metrics(step_count, true);
+    if (trajectory) {
+        if (world_rank == 0) {
+            trajectory->end(step_count, game.worm.row, game.worm.col, game.worm.dir);
+        }
+        collective_assert(trajectory->finish(), "Cannot write file "
+                          << std::quoted(options.trajectory_file + "." + std::to_string(world_rank)));
+    }
+    wait_halo();
+    free_halo_types();
+    if (!options.checkpoint_file.empty()) {
+        write_checkpoint_regions(options.checkpoint_file);
+    } else if (options.delta) {
+        gather_delta(out);
+    } else {
+        combine_states();
+        if (world_rank == 0) print_state(out);
+    }
+    if (world_rank == 0) {
+        out << "Stepped iterations: " << step_count << std::endl;
+    }
+    return "";
+}
+
+// --serve: rank 0 takes the requests one connection at a time on a UNIX socket, and every
+// process runs them together on the regions, as if each had been given on the command line.
+// A request is one line, `<state-file> <number-of-iteration>`, answered with what would be
+// printed for it, sent as it is printed, or `Error: <message>`. The request `quit` stops the
+// server.
+
+// Returns the message to answer with if the request is not valid, empty if it is.
+std::string read_request(int client, std::string& state_file, unsigned long& iteration_count, bool& quit) {
+    std::string line;
+    char c;
+    while (line.size() < 4096 && recv(client, &c, 1, 0) == 1 && c != '\n') {
+        line += c;
+    }
+    std::istringstream ss(line);
+    std::string iterations, rest;
+    if (!(ss >> state_file)) return "Empty request";
+    quit = state_file == "quit";
+    if (quit) return "";
+    if (!(ss >> iterations) || ss >> rest) return "The request must be <state-file> <number-of-iteration>";
+    try {
+        size_t end;
+        iteration_count = std::stoul(iterations, &end);
+        if (end != iterations.size() || iterations[0] == '-') throw 0;
+    } catch (...) {
+        return "Invalid number of iteration " + iterations;
+    }
+    return "";
+}
+
+// parse_state exits on an invalid header, so the header of a request is checked first. The
+// board is only read by divide_states, which answers its errors.
+std::string check_state_file(const std::string& filename) {
+    GameInfo game;
+    std::vector<int> rule;
+    int visited[1 << 5];
+    size_t total;
+    if (is_checkpoint(filename)) return read_checkpoint_header(filename, game, rule, visited, total);
+    std::ifstream inp(filename);
+    if (!inp) return "Can not open file \"" + filename + "\"";
+    std::vector<WormState> worms;
+    bool own_bindings;
+    std::string error = read_state_header(inp, game, rule, visited, total, worms, own_bindings);
+    if (error.empty() && !worms.empty()) return "A state file with several worms can not be served";
+    return error;
+}
+
+// Sends the whole reply and closes the connection, the client may already be gone.
+void send_reply(int client, const std::string& reply) {
+    for (size_t sent = 0; sent < reply.size();) {
+        ssize_t count = send(client, reply.data() + sent, reply.size() - sent, MSG_NOSIGNAL);
+        if (count <= 0) break;
+        sent += count;
+    }
+    close(client);
+}
+
+// What is printed for a request, sent to the client as it goes instead of held until the
+// end, so the board never has to be kept twice. A client that is gone gets nothing more.
+class SocketBuffer : public std::streambuf {
+    int client;
+    char buffer[1 << 16];
+protected:
+    int overflow(int c) override {
+        sync();
+        if (c != traits_type::eof()) {
+            *pptr() = c;
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+    int sync() override {
+        for (const char* it = pbase(); client >= 0 && it < pptr();) {
+            ssize_t count = send(client, it, pptr() - it, MSG_NOSIGNAL);
+            if (count <= 0) client = -1;
+            else it += count;
+        }
+        setp(buffer, buffer + sizeof(buffer));
+        return 0;
+    }
+public:
+    explicit SocketBuffer(int client_) : client(client_) {
+        setp(buffer, buffer + sizeof(buffer));
+    }
+};
+
+// Returns the listening socket on rank 0, -1 if it cannot be opened.
+int open_server_socket(const std::string& path) {
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) return -1;
+    std::strcpy(addr.sun_path, path.c_str());
+    // a socket left by a server that did not stop cleanly, but never any other file.
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) unlink(path.c_str());
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) return -1;
+    if (bind(listener, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listener, 16) != 0) {
+        close(listener);
+        return -1;
+    }
+    return listener;
+}
+
+void serve() {
+    int listener = world_rank == 0 ? open_server_socket(options.socket_file) : 0;
+    collective_assert(listener >= 0, "Cannot listen on " << std::quoted(options.socket_file));
+    while (true) {
+        // the other processes wait in the broadcast of the next job.
+        int client = -1;
+        std::string state_file;
+        unsigned long iteration_count = 0;
+        bool quit = false;
+        while (world_rank == 0) {
+            client = accept(listener, nullptr, nullptr);
+            if (client < 0) continue;
+            // a client that never sends its request must not block the server.
+            timeval timeout = {10, 0};
+            setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            std::string error = read_request(client, state_file, iteration_count, quit);
+            if (error.empty() && !quit) error = check_state_file(state_file);
+            if (error.empty()) break;
+            send_reply(client, "Error: " + error + "\n");
+        }
+        size_t name_size = state_file.size();
+        MPI_Bcast(&quit, sizeof(bool), MPI_BYTE, 0, MPI_COMM_WORLD);
+        MPI_Bcast(&iteration_count, 1, MPI_UNSIGNED_LONG, 0, MPI_COMM_WORLD);
+        MPI_Bcast(&name_size, sizeof(size_t), MPI_BYTE, 0, MPI_COMM_WORLD);
+        state_file.resize(name_size);
+        MPI_Bcast(&state_file[0], name_size, MPI_CHAR, 0, MPI_COMM_WORLD);
+        if (quit) {
+            if (world_rank == 0) send_reply(client, "Stopped\n");
+            break;
+        }
+        if (LOG_ENABLED(LOG_DEBUG)) {
+            log << "serving " << std::quoted(state_file) << ' ' << iteration_count << std::endl;
+        }
+        options.state_file = state_file;
+        options.iteration_count = iteration_count;
+        board_ascii.clear();
+        if (world_rank == 0) {
+            checkpoint_input = is_checkpoint(state_file);
+            parse_state(false);
+        }
+        // the others print nothing.
+        SocketBuffer buffer(world_rank == 0 ? client : -1);
+        std::ostream out(&buffer);
+        std::string error = run_distributed(out);
+        if (world_rank == 0) {
+            if (!error.empty()) out << "Error: " << error << '\n';
+            out.flush();
+            close(client);
+        }
+    }
+    free_node_window();
+    if (world_rank == 0) {
+        close(listener);
+        unlink(options.socket_file.c_str());
+    }
+}
+
+// Runs the jobs of --batch then exits, with 1 if any of them failed.
+void run_batch_manifest() {
+    std::vector<BatchJob> jobs;
+    std::string error = read_manifest(options.batch_file, jobs);
+    collective_assert(error.empty(), error);
+    int thread_count = options.thread_count;
+    if (thread_count == 0) {
+        // the processes of a node share its cores.
+        int node_size;
+        MPI_Comm_size(node_comm, &node_size);
+        thread_count = std::max(1, (int)std::thread::hardware_concurrency() / node_size);
+    }
+    int failed = run_batch(jobs, thread_count), total_failed;
+    MPI_Reduce(&failed, &total_failed, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+    if (world_rank == 0) {
+        std::cout << "Batch: " << jobs.size() << " jobs, " << total_failed << " failed" << std::endl;
+    }
+    report_phase_stats();
+    MPI_Bcast(&total_failed, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    finalize_then_exit(total_failed ? 1 : 0);
+}
+
 int main(int argc, char** argv) {
     MPI_Init(&argc, &argv);
     MPI_Comm_size(MPI_COMM_WORLD, &world_size);
     MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &node_comm);
+    {
+        MPI_Group world_group, node_group;
+        MPI_Comm_group(MPI_COMM_WORLD, &world_group);
+        MPI_Comm_group(node_comm, &node_group);
+        std::vector<int> ranks(world_size);
+        for (int i = 0; i < world_size; ++i) ranks[i] = i;
+        node_rank_of.resize(world_size);
+        MPI_Group_translate_ranks(world_group, world_size, ranks.data(), node_group, node_rank_of.data());
+        for (auto& rank: node_rank_of) {
+            if (rank == MPI_UNDEFINED) rank = -1;
+        }
+        MPI_Group_free(&world_group);
+        MPI_Group_free(&node_group);
+    }
 
     // Get the name of the processor
     MPI_Get_processor_name(processor_name, &name_len);
 
-    if (argc < 3) {
+    if (!parse_options(argc, argv, options)) {
         if (world_rank == 0) {
             print_usage(argc, argv);
         }
         finalize_then_exit(0);
     }
-    
+    if (!options.batch_file.empty()) {
+        run_batch_manifest();
+    }
+    if (!options.socket_file.empty()) {
+        serve();
+        report_phase_stats();
+        finalize_then_exit(0);
+    }
     if (world_rank == 0) {
-        parse_state(argc, argv);
+        checkpoint_input = is_checkpoint(options.state_file);
+        worm_list_input = !checkpoint_input && has_worm_list(options.state_file);
     }
-    // broadcasting some info
-    MPI_Bcast(&game, sizeof(GameInfo), MPI_BYTE, 0, MPI_COMM_WORLD);
-    if (std::getenv("DEBUG")) {
-        log << "Recived size: " << game.width << ' ' << game.height << "; iter count: " << game.iteration_count << std::endl;
+    MPI_Bcast(&worm_list_input, sizeof(bool), MPI_BYTE, 0, MPI_COMM_WORLD);
+    // the delta is from the ASCII board, see build/apply-delta.
+    collective_assert(!options.delta || !checkpoint_input, "--delta needs an ASCII state file.");
+    if (worm_list_input && (options.sequential || options.sparse || options.infinite || options.fast_forward
+                            || options.sweep_length || !options.sweep_list.empty() || !options.checkpoint_file.empty()
+                            || !options.trajectory_file.empty() || !options.keyframe_file.empty())) {
+        if (world_rank == 0) {
+            std::cerr << "A state file with several worms is only run on the regions, without --sequential, --sparse, "
+                      << "--infinite, --fast-forward, --sweep, --sweep-list, --checkpoint, --trajectory nor --keyframes." << std::endl;
+        }
+        finalize_then_exit(1);
     }
-
-    divide_regions();
-    divide_states();
-    int step_count = 0;
-    while (game.iteration_count-- > 0) {
-        if (!game_step()) {
-            break;
+    
+    if (options.sweep_length || !options.sweep_list.empty()) {
+        SequentialGame initial(game, rule, visited_state, total_visited_state);
+        std::vector<std::vector<int>> rules;
+        if (world_rank == 0) {
+            parse_state();
+            initial = SequentialGame(game, rule, visited_state, total_visited_state);
+            load_board(initial);
+            if (options.sweep_length) {
+                rules = enumerate_rules(options.sweep_length);
+            } else if (!read_rule_list(options.sweep_list, rules)) {
+                finalize_then_exit(1);
+            }
+            if (mirror_symmetric(initial)) {
+                drop_mirrored(rules);
+            }
         }
-        ++step_count;
+        run_sweep(initial, rules, options.cache_file);
+        report_phase_stats();
+        finalize_then_exit(0);
+    }
+    
+    if (options.sparse || options.infinite || options.fast_forward) {
+        if (world_rank == 0) {
+            parse_state();
+            run_sparse();
+        }
+        report_phase_stats();
+        finalize_then_exit(0);
+    }
+    
+    if (!worm_list_input && (options.sequential || (world_size == 1 && !options.distributed))) {
+        if (world_rank == 0) {
+            parse_state();
+            run_sequential();
+        }
+        report_phase_stats();
+        finalize_then_exit(0);
     }
-    combine_states();
+    
     if (world_rank == 0) {
-        print_state();
-        std::cout << "Stepped iterations: " << step_count << std::endl;
+        parse_state(false);
+    }
+    std::string error = run_distributed(std::cout);
+    free_node_window();
+    if (!error.empty()) {
+        if (world_rank == 0) {
+            std::cerr << "Error while parsing state file " << std::quoted(options.state_file) << ": " << error << std::endl;
+        }
+        finalize_then_exit(1);
     }
+    report_phase_stats();
 
     finalize_then_exit(0);
 }
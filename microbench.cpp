@@ -0,0 +1,361 @@
+#include <mpi.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#include "chess-board-region.h"
+#include "rule.h"
+#include "state.h"
+
+// Times the kernels of the stepping hot path one by one, on a synthetic board and a random
+// walk over it, without MPI processes or a state file. Prints one CSV line per kernel, with
+// the cycles, instructions and cache misses per operation when the perf events can be read
+// (`-` otherwise). The results can be saved and compared with a later run to catch a
+// kernel that got slower.
+
+int world_size = 1;
+int world_rank = 0;
+
+static const int rule_values[] = {0, 1, 2, 4, 5};
+
+void print_usage(char** argv) {
+    using std::cerr;
+    using std::endl;
+    cerr << "Usage:" << endl;
+    cerr << "\t" << argv[0] << " [options]" << endl;
+    cerr << "Options:" << endl;
+    cerr << "\t--size <n>\tthe side of the region (default 1024)." << endl;
+    cerr << "\t--ops <n>\tthe cells each kernel goes through per repetition (default 4194304)." << endl;
+    cerr << "\t--repeat <n>\tthe repetitions of each kernel, the fastest is kept (default 5)." << endl;
+    cerr << "\t--seed <n>\tthe seed of the board, the walk and the rule (default 1)." << endl;
+    cerr << "\t--density <p>\tthe probability of each edge on the board (default 0.1)." << endl;
+    cerr << "\t--kernels <a,b,...>\tonly these kernels (default all)." << endl;
+    cerr << "\t--save <file>\twrite the results to the file, as a baseline for --baseline." << endl;
+    cerr << "\t--baseline <file>\tcompare with the results saved in the file, and fail if a kernel" << endl;
+    cerr << "\t\t\tof the same size is slower by more than --tolerance percent." << endl;
+    cerr << "\t--tolerance <p>\tthe percent a kernel may lose against the baseline (default 10)." << endl;
+    cerr << "An operation is one cell, or one column or row of the region for the halo kernels." << endl;
+}
+
+#ifdef __linux__
+// The hardware counters of this thread, each opened on its own so that the ones the machine
+// lacks (or a container forbids) are just left out.
+class PerfCounters {
+    int fds[3];
+public:
+    PerfCounters() {
+        static const uint64_t configs[3] = {
+            PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES,
+        };
+        for (int i = 0; i < 3; ++i) {
+            perf_event_attr attr = {};
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[i];
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        }
+    }
+    ~PerfCounters() {
+        for (int fd: fds) if (fd >= 0) close(fd);
+    }
+    void start() {
+        for (int fd: fds) {
+            if (fd < 0) continue;
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+    // the counts since start, -1 for a counter that cannot be read.
+    void stop(double* counts) {
+        for (int i = 0; i < 3; ++i) {
+            uint64_t value;
+            counts[i] = -1;
+            if (fds[i] < 0) continue;
+            ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fds[i], &value, sizeof(value)) == sizeof(value)) counts[i] = value;
+        }
+    }
+};
+#else
+class PerfCounters {
+public:
+    void start() {}
+    void stop(double* counts) { counts[0] = counts[1] = counts[2] = -1; }
+};
+#endif
+
+struct Kernel {
+    std::string name;
+    // the cells of one operation.
+    unsigned long cells;
+    // runs the operations, returns something that depends on them so they are not left out.
+    std::function<unsigned long(unsigned long ops)> run;
+};
+
+struct Result {
+    double ns, counts[3];
+};
+
+// where the kernels leave their result.
+volatile unsigned long sink;
+
+Result measure(Kernel& kernel, unsigned long ops, int repeat, PerfCounters& counters) {
+    sink = kernel.run(ops);
+    Result best = {-1, {-1, -1, -1}};
+    for (int i = 0; i < repeat; ++i) {
+        Result cur;
+        auto start = std::chrono::steady_clock::now();
+        counters.start();
+        sink = kernel.run(ops);
+        counters.stop(cur.counts);
+        auto end = std::chrono::steady_clock::now();
+        cur.ns = std::chrono::duration<double, std::nano>(end - start).count() / ops;
+        for (auto& count: cur.counts) if (count >= 0) count /= ops;
+        if (best.ns < 0 || cur.ns < best.ns) best = cur;
+    }
+    return best;
+}
+
+std::string format_count(double value) {
+    if (value < 0) return "-";
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3) << value;
+    return out.str();
+}
+
+// the ns per operation of each (kernel, size) of a file written with --save.
+bool read_baseline(const std::string& filename, std::map<std::pair<std::string, unsigned long>, double>& baseline) {
+    std::ifstream inp(filename);
+    if (!inp) return false;
+    std::string line;
+    std::getline(inp, line);
+    while (std::getline(inp, line)) {
+        std::istringstream fields(line);
+        std::string name, size, ops, ns;
+        if (!std::getline(fields, name, ',') || !std::getline(fields, size, ',')
+                || !std::getline(fields, ops, ',') || !std::getline(fields, ns, ',')) {
+            return false;
+        }
+        try {
+            baseline[{name, std::stoul(size)}] = std::stod(ns);
+        } catch (...) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    unsigned long size = 1024, total_ops = 1 << 22, seed = 1;
+    int repeat = 5;
+    double density = 0.1, tolerance = 10;
+    std::string kernel_list, save_file, baseline_file;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+        if (i + 1 == argc) {
+            print_usage(argv);
+            return 1;
+        }
+        std::string value(argv[++i]);
+        try {
+            if (arg == "--size") size = std::stoul(value);
+            else if (arg == "--ops") total_ops = std::stoul(value);
+            else if (arg == "--repeat") repeat = std::stoi(value);
+            else if (arg == "--seed") seed = std::stoul(value);
+            else if (arg == "--density") density = std::stod(value);
+            else if (arg == "--kernels") kernel_list = "," + value + ",";
+            else if (arg == "--save") save_file = value;
+            else if (arg == "--baseline") baseline_file = value;
+            else if (arg == "--tolerance") tolerance = std::stod(value);
+            else throw 0;
+        } catch (...) {
+            print_usage(argv);
+            return 1;
+        }
+    }
+    if (size < 2 || total_ops == 0 || repeat <= 0) {
+        print_usage(argv);
+        return 1;
+    }
+    std::map<std::pair<std::string, unsigned long>, double> baseline;
+    if (!baseline_file.empty() && !read_baseline(baseline_file, baseline)) {
+        std::cerr << "Cannot read the baseline " << std::quoted(baseline_file) << std::endl;
+        return 1;
+    }
+    // only for the datatypes of the halo.
+    MPI_Init(&argc, &argv);
+
+    std::mt19937_64 gen(seed);
+    std::bernoulli_distribution edge(density);
+    int h = size, w = size;
+    // the ghost row and column are drawn as well, as if they came from the neighbours.
+    ChessBoardRegion reg(h, w), other(h, w);
+    for (int r = -1; r < h; ++r) {
+        for (int c = -1; c < w; ++c) {
+            reg.set(r, c, edge(gen) | edge(gen) << 1 | edge(gen) << 2);
+        }
+    }
+
+    // a walk turning as a worm may (never straight back), wrapped around the region. The
+    // kernels go through it over and over, it is kept small enough to stay in the cache.
+    struct Step { int row, col, dir, state; };
+    std::vector<Step> walk(1 << 16);
+    const unsigned long walk_mask = walk.size() - 1;
+    Step cur = {h / 2, w / 2, 0, 0};
+    for (auto& step: walk) {
+        cur.dir = (cur.dir + rule_values[gen() % 5]) % 6;
+        cur.row = (cur.row + dr[cur.dir] + h) % h;
+        cur.col = (cur.col + dc[cur.dir] + w) % w;
+        cur.state = reg.get_state(cur.row, cur.col);
+        step = cur;
+    }
+    std::vector<int> rule(1 << 5);
+    for (auto& x: rule) x = rule_values[gen() % 5];
+    int visited_state[1 << 5];
+    size_t total_visited_state = 0;
+    std::fill(visited_state, visited_state + (1 << 5), -1);
+    TransitionTable transitions;
+
+    MPI_Datatype column_type;
+    MPI_Type_vector(h, 1, reg.get_stride(), MPI_BYTE, &column_type);
+    MPI_Type_commit(&column_type);
+    std::vector<char> packed(h);
+
+    std::vector<Kernel> kernels = {
+        {"get_state", 1, [&](unsigned long ops) {
+            unsigned long res = 0;
+            for (unsigned long i = 0; i < ops; ++i) {
+                const Step& s = walk[i & walk_mask];
+                res += reg.get_state(s.row, s.col);
+            }
+            return res;
+        }},
+        // the edges drawn stay on the board, which is why it is a copy.
+        {"upd_state", 1, [&](unsigned long ops) {
+            for (unsigned long i = 0; i < ops; ++i) {
+                const Step& s = walk[i & walk_mask];
+                other.upd_state(s.row, s.col, s.dir);
+            }
+            return (unsigned long)other(h / 2, w / 2);
+        }},
+        {"rotate_right", 1, [&](unsigned long ops) {
+            unsigned long res = 0;
+            for (unsigned long i = 0; i < ops; ++i) {
+                const Step& s = walk[i & walk_mask];
+                res += rotate_right(s.state, 6, s.dir);
+            }
+            return res;
+        }},
+        {"query_state", 1, [&](unsigned long ops) {
+            unsigned long res = 0;
+            for (unsigned long i = 0; i < ops; ++i) {
+                const Step& s = walk[i & walk_mask];
+                res += query_state(rotate_right(s.state, 6, s.dir), rule, visited_state, total_visited_state);
+            }
+            return res;
+        }},
+        // what the engines call instead of query_state, see TransitionTable.
+        {"transition", 1, [&](unsigned long ops) {
+            unsigned long res = 0;
+            for (unsigned long i = 0; i < ops; ++i) {
+                const Step& s = walk[i & walk_mask];
+                res += transitions.next(s.state, s.dir, rule, visited_state, total_visited_state);
+            }
+            return res;
+        }},
+        // the last column as it is sent to the right neighbour, and received into its ghost column.
+        {"pack_column", size, [&](unsigned long ops) {
+            for (unsigned long i = 0; i < ops; ++i) {
+                int pos = 0;
+                MPI_Pack(reg.cell_data(0, w - 1), 1, column_type, packed.data(), h, &pos, MPI_COMM_SELF);
+            }
+            return (unsigned long)packed[0];
+        }},
+        {"unpack_column", size, [&](unsigned long ops) {
+            for (unsigned long i = 0; i < ops; ++i) {
+                int pos = 0;
+                MPI_Unpack(packed.data(), h, &pos, other.cell_data(0, -1), 1, column_type, MPI_COMM_SELF);
+            }
+            return (unsigned long)other(0, -1);
+        }},
+        // the copies between the regions of a node (see copy_halo_piece in main.cpp).
+        {"copy_column", size, [&](unsigned long ops) {
+            for (unsigned long i = 0; i < ops; ++i) {
+                for (int r = 0; r < h; ++r) other.set(r, -1, reg(r, w - 1));
+            }
+            return (unsigned long)other(h - 1, -1);
+        }},
+        {"copy_row", size, [&](unsigned long ops) {
+            for (unsigned long i = 0; i < ops; ++i) {
+                std::copy_n(reg.row_data(h - 1), reg.row_bytes(), other.row_data(-1));
+            }
+            return (unsigned long)other(-1, 0);
+        }},
+    };
+    for (int r = -1; r < h; ++r) {
+        for (int c = -1; c < w; ++c) other.set(r, c, reg(r, c));
+    }
+
+    std::ofstream save;
+    if (!save_file.empty()) {
+        save.open(save_file, std::ios::trunc);
+        if (!save) {
+            std::cerr << "Cannot write file " << std::quoted(save_file) << std::endl;
+            MPI_Finalize();
+            return 1;
+        }
+    }
+    std::string header = "kernel,size,ops,ns_per_op,cycles_per_op,instructions_per_op,cache_misses_per_op";
+    std::cout << header << (baseline_file.empty() ? "" : ",baseline_ns_per_op,change") << std::endl;
+    if (save) save << header << '\n';
+    PerfCounters counters;
+    int slower = 0;
+    for (auto& kernel: kernels) {
+        if (!kernel_list.empty() && kernel_list.find("," + kernel.name + ",") == std::string::npos) continue;
+        unsigned long ops = std::max(1ul, total_ops / kernel.cells);
+        Result res = measure(kernel, ops, repeat, counters);
+        std::ostringstream line;
+        line << kernel.name << ',' << size << ',' << ops << ',' << format_count(res.ns);
+        for (double count: res.counts) line << ',' << format_count(count);
+        if (save) save << line.str() << '\n';
+        if (!baseline_file.empty()) {
+            auto it = baseline.find({kernel.name, size});
+            if (it == baseline.end()) {
+                line << ",-,-";
+            } else {
+                double change = (res.ns / it->second - 1) * 100;
+                line << ',' << format_count(it->second) << ',' << std::showpos << std::fixed
+                     << std::setprecision(1) << change << '%' << std::noshowpos;
+                if (change > tolerance) {
+                    line << " slower";
+                    ++slower;
+                }
+            }
+        }
+        std::cout << line.str() << std::endl;
+    }
+    MPI_Type_free(&column_type);
+    MPI_Finalize();
+    if (slower) {
+        std::cerr << slower << " kernel(s) slower than the baseline by more than " << tolerance << "%" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,119 @@
+#include <vector>
+#include "decomposition.h"
+#include "options.h"
+
+bool parse_options(int argc, char** argv, Options& options) {
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+        // the options that take a value.
+        if (arg == "--sweep" || arg == "--sweep-list" || arg == "--cache" || arg == "--stats"
+                || arg == "--checkpoint" || arg == "--trajectory"
+                || arg == "--keyframes" || arg == "--keyframe-interval"
+                || arg == "--metrics" || arg == "--metrics-interval"
+                || arg == "--batch" || arg == "--threads" || arg == "--serve" || arg == "--layout") {
+            if (++i == argc) return false;
+            std::string value(argv[i]);
+            if (arg == "--sweep") {
+                try {
+                    options.sweep_length = std::stoi(value);
+                } catch (...) {
+                    return false;
+                }
+                if (options.sweep_length <= 0) return false;
+            } else if (arg == "--sweep-list") {
+                options.sweep_list = value;
+            } else if (arg == "--checkpoint") {
+                options.checkpoint_file = value;
+            } else if (arg == "--keyframes") {
+                options.keyframe_file = value;
+            } else if (arg == "--keyframe-interval") {
+                try {
+                    options.keyframe_interval = std::stoul(value);
+                } catch (...) {
+                    return false;
+                }
+                if (options.keyframe_interval == 0) return false;
+            } else if (arg == "--metrics") {
+                options.metrics_file = value;
+            } else if (arg == "--metrics-interval") {
+                try {
+                    options.metrics_interval = std::stoul(value);
+                } catch (...) {
+                    return false;
+                }
+                if (options.metrics_interval == 0) return false;
+            } else if (arg == "--layout") {
+                if (!valid_layout(value)) return false;
+                options.layout = value;
+            } else if (arg == "--serve") {
+                options.socket_file = value;
+            } else if (arg == "--batch") {
+                options.batch_file = value;
+            } else if (arg == "--threads") {
+                try {
+                    options.thread_count = std::stoi(value);
+                } catch (...) {
+                    return false;
+                }
+                if (options.thread_count <= 0) return false;
+            } else if (arg == "--trajectory") {
+                options.trajectory_file = value;
+            } else if (arg == "--stats") {
+                if (value != "text" && value != "json") return false;
+                options.stats = value;
+            } else {
+                options.cache_file = value;
+            }
+        } else if (arg == "--sequential") {
+            options.sequential = true;
+        } else if (arg == "--sparse") {
+            options.sparse = true;
+        } else if (arg == "--infinite") {
+            options.infinite = true;
+        } else if (arg == "--fast-forward") {
+            options.fast_forward = true;
+        } else if (arg == "--distributed") {
+            options.distributed = true;
+        } else if (arg == "--no-shared-memory") {
+            options.shared_memory = false;
+        } else if (arg == "--delta") {
+            options.delta = true;
+        } else if (arg.size() > 2 && arg.compare(0, 2, "--") == 0) {
+            return false;
+        } else {
+            positional.push_back(arg);
+        }
+    }
+    // a batch takes its state files from the manifest and runs them sequentially, a server
+    // takes them from its clients and runs them on the regions.
+    if (!options.batch_file.empty() || !options.socket_file.empty()) {
+        if (!options.socket_file.empty() && (!options.batch_file.empty() || options.thread_count)) return false;
+        return positional.empty() && !options.sequential && !options.distributed && !options.sparse
+            && !options.infinite && !options.fast_forward && !options.sweep_length && options.sweep_list.empty()
+            && options.checkpoint_file.empty() && options.trajectory_file.empty() && options.keyframe_file.empty()
+            && !options.delta && options.metrics_file.empty();
+    }
+    if (options.thread_count) return false;
+    if (positional.size() != 2) return false;
+    if (options.sequential && options.distributed) return false;
+    if (options.sweep_length && !options.sweep_list.empty()) return false;
+    // the delta replaces the printed board.
+    if (options.delta && (options.sweep_length || !options.sweep_list.empty() || !options.checkpoint_file.empty())) {
+        return false;
+    }
+    if (!options.metrics_file.empty() && (options.sweep_length || !options.sweep_list.empty())) return false;
+    // the sparse board only has the sequential engine, and no checkpoint.
+    if ((options.sparse || options.infinite || options.fast_forward) && (options.distributed || options.delta
+            || !options.metrics_file.empty() || options.sweep_length
+            || !options.sweep_list.empty() || !options.checkpoint_file.empty() || !options.keyframe_file.empty())) {
+        return false;
+    }
+    options.state_file = positional[0];
+    try {
+        options.iteration_count = std::stoul(positional[1]);
+    } catch (...) {
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <string>
+
+struct Options {
+    std::string state_file;
+    unsigned long iteration_count = 0;
+    // run the whole board in one process, without any communication.
+    bool sequential = false;
+    // use the regions even when there is only one process.
+    bool distributed = false;
+    // how the board is cut into the regions (see decomposition.h).
+    std::string layout = "diagonal";
+    // keep the regions of the processes of a node in one shared window (see main.cpp).
+    bool shared_memory = true;
+    // store the board in tiles allocated when needed (see SparseBoard), in one process.
+    bool sparse = false;
+    // the same, on the infinite plane instead of the torus.
+    bool infinite = false;
+    // skip the moves the worm is sure to repeat, on the sparse board.
+    bool fast_forward = false;
+    // run every rule up to this length instead of the rule of the state file.
+    int sweep_length = 0;
+    // run every rule of this file instead of the rule of the state file.
+    std::string sweep_list;
+    // where the results of the sweep are kept between runs.
+    std::string cache_file;
+    // where the final state is written as a binary checkpoint, empty to print it.
+    std::string checkpoint_file;
+    // print only the cells changed since the state file instead of the board.
+    bool delta = false;
+    // where the path of the worm is recorded, empty for nowhere.
+    std::string trajectory_file;
+    // where the keyframes are written, empty for none, and how many steps apart.
+    std::string keyframe_file;
+    unsigned long keyframe_interval = 1000000;
+    // where the run stats are written every metrics_interval steps and at the end, empty for nowhere.
+    std::string metrics_file;
+    unsigned long metrics_interval = 1000000;
+    // the manifest of the jobs to run instead of one state file (see batch.h), and the threads
+    // of each process for them, 0 to share the cores of the node between its processes.
+    std::string batch_file;
+    int thread_count = 0;
+    // the UNIX socket to take the jobs from with --serve, empty to run the state file.
+    std::string socket_file;
+    // "text" or "json" to print the time spent in each phase at the end, empty for none.
+    std::string stats;
+};
+
+extern Options options;
+
+// Returns false if the arguments are not valid, so the usage should be printed.
+bool parse_options(int argc, char** argv, Options& options);
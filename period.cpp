@@ -0,0 +1,25 @@
+#include "period.h"
+#include "state.h"
+
+void MoveHistory::push(int dir) {
+    row += dr[dir];
+    col += dc[dir];
+    int i = index(count++);
+    rows[i] = row;
+    cols[i] = col;
+    dirs[i] = dir;
+}
+
+int MoveHistory::find_period() const {
+    for (int p = 1; p <= max_period && 2 * (unsigned long)p + 1 <= count; ++p) {
+        // the same direction at the end of both runs, and the same move for both.
+        if (dir_at(0) != dir_at(p)) continue;
+        int64_t move_row = row_at(0) - row_at(p), move_col = col_at(0) - col_at(p);
+        if (move_row == 0 && move_col == 0) continue;
+        if (row_at(p) - row_at(2 * p) != move_row || col_at(p) - col_at(2 * p) != move_col) continue;
+        int i = 1;
+        while (i < p && dir_at(i) == dir_at(i + p)) ++i;
+        if (i == p) return p;
+    }
+    return 0;
+}
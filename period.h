@@ -0,0 +1,42 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// The last moves of the worm, to find when it has started to repeat itself.
+// The positions are on the plane (not wrapped), from where the history was cleared.
+class MoveHistory {
+public:
+    // the longest period looked for.
+    static const int max_period = 4096;
+    // the steps between two searches, doubled up to max_check_interval while none finds a period.
+    static const unsigned long check_interval = 1024, max_check_interval = 1 << 16;
+private:
+    // a power of two holding two periods and the position before them.
+    static const int capacity = 4 * max_period;
+    std::vector<int64_t> rows, cols;
+    std::vector<char> dirs;
+    int64_t row = 0, col = 0;
+    unsigned long count = 0;
+
+    static int index(unsigned long i) { return i & (capacity - 1); }
+public:
+    MoveHistory() : rows(capacity), cols(capacity), dirs(capacity) {}
+
+    void clear() {
+        row = col = 0;
+        count = 0;
+    }
+
+    // a step in the direction.
+    void push(int dir);
+
+    unsigned long size() const { return count; }
+    // after the step `back` steps before the last one.
+    int64_t row_at(int back) const { return rows[index(count - 1 - back)]; }
+    int64_t col_at(int back) const { return cols[index(count - 1 - back)]; }
+    int dir_at(int back) const { return dirs[index(count - 1 - back)]; }
+
+    // The smallest p whose last two runs of p steps went in the same directions and moved
+    // the worm, 0 if there is none.
+    int find_period() const;
+};
@@ -0,0 +1,95 @@
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "checkpoint.h"
+#include "sequential-engine.h"
+#include "state-file.h"
+
+// Rebuilds the state of a run at any step from the keyframes written with --keyframes:
+// the last keyframe before the step is loaded, and the worm is moved from there.
+
+void print_usage(char** argv) {
+    using std::cerr;
+    using std::endl;
+    cerr << "Usage:" << endl;
+    cerr << "\t" << argv[0] << " <keyframe-file> <step> [--checkpoint <file>]" << endl;
+    cerr << "Prints the state after <step> steps of the run that wrote <keyframe-file>, in the" << endl;
+    cerr << "format of the state file, or writes it as a binary checkpoint with --checkpoint." << endl;
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::string> positional;
+    std::string checkpoint_file;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+        if (arg == "--checkpoint" && i + 1 < argc) {
+            checkpoint_file = argv[++i];
+        } else {
+            positional.push_back(arg);
+        }
+    }
+    unsigned long step;
+    try {
+        if (positional.size() != 2) throw 0;
+        step = std::stoul(positional[1]);
+    } catch (...) {
+        print_usage(argv);
+        return 1;
+    }
+    const std::string& keyframe_file = positional[0];
+
+    std::string index_file = keyframe_file + ".index";
+    std::ifstream index(index_file);
+    if (!index) {
+        std::cerr << "Can not open file " << std::quoted(index_file) << std::endl;
+        return 1;
+    }
+    // the index is in the order of the steps.
+    unsigned long key_step, best_step = 0;
+    size_t offset, best_offset = 0;
+    bool found = false;
+    while (index >> key_step >> offset && key_step <= step) {
+        best_step = key_step;
+        best_offset = offset;
+        found = true;
+    }
+    if (!found) {
+        std::cerr << "There is no keyframe before the step " << step << std::endl;
+        return 1;
+    }
+
+    GameInfo game;
+    std::vector<int> rule;
+    int visited_state[1 << 5];
+    size_t total_visited_state;
+    std::string error = read_checkpoint_header(keyframe_file, game, rule, visited_state, total_visited_state, best_offset);
+    if (!error.empty()) {
+        std::cerr << "Error while parsing keyframe at " << best_offset << ": " << error << std::endl;
+        return 1;
+    }
+    // a dead worm stays where it is.
+    game.iteration_count = game.worm.dir == -1 ? 0 : step - best_step;
+    SequentialGame seq(game, rule, visited_state, total_visited_state);
+    if (!read_checkpoint_cells(keyframe_file, seq.cells, best_offset)) {
+        std::cerr << "Error while reading keyframe at " << best_offset << std::endl;
+        return 1;
+    }
+    seq.steps_done = best_step;
+    seq.run();
+
+    if (!checkpoint_file.empty()) {
+        CheckpointHeader header = make_checkpoint_header(seq.game, seq.rule, seq.visited_state, seq.total_visited_state);
+        if (!write_checkpoint(checkpoint_file, header, seq.cells)) {
+            std::cerr << "Cannot write file " << std::quoted(checkpoint_file) << std::endl;
+            return 1;
+        }
+    } else {
+        std::vector<std::string> board_ascii(2 * seq.game.height, std::string(2 * seq.game.width, ' '));
+        seq.write_board(board_ascii);
+        write_state(std::cout, seq.game, seq.rule, seq.visited_state, seq.total_visited_state, board_ascii);
+    }
+    std::cout << "Stepped iterations: " << seq.steps_done << std::endl;
+    return 0;
+}
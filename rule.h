@@ -0,0 +1,61 @@
+#pragma once
+#include <cstddef>
+#include <cstring>
+#include <vector>
+#include "utils.h"
+#include "trace.h"
+
+// the rotated state without the edge the worm came by, as it is bound to the rule.
+inline int reduce_state(int state) {
+    return (state & ((1 << 3) - 1)) | (state >> 4) << 3;
+}
+
+// Returns the direction (relative to the worm) that the rule chooses for the rotated state,
+// or -1 if the worm dies. A state that has not been seen before is bound to the next rule.
+// RuleLength, when not 0, must be rule.size().
+template<int RuleLength = 0>
+inline int query_state(int state, const std::vector<int>& rule, int* visited_state, size_t& total_visited_state) {
+    int reduced_state = reduce_state(state);
+    if (visited_state[reduced_state] == -1) {
+        visited_state[reduced_state] = total_visited_state++;
+    }
+    int rule_id = visited_state[reduced_state];
+    if (rule_id >= (RuleLength ? RuleLength : (int)rule.size())) {
+        return -1;
+    }
+    int choice = rule[rule_id];
+    if (GETBIT(state, choice)) {
+        return -1;
+    }
+    return choice;
+}
+
+// The outcome of query_state for every (cell state, worm direction) pair, filled the first
+// time each pair is met. Once a state is bound its outcome is fixed, so an entry stays valid
+// as long as the rule is the same and the bindings only grow (which is also the case when
+// the bindings come back with the worm from another process).
+class TransitionTable {
+    static const signed char unknown = -2;
+    // indexed by (direction << 6 | state), the new absolute direction or -1.
+    signed char next_dir[6 << 6];
+public:
+    TransitionTable() { reset(); }
+
+    // must be called when the rule or the bindings are replaced.
+    void reset() {
+        std::memset(next_dir, unknown, sizeof(next_dir));
+    }
+
+    // state is the unrotated state of the cell (as given by get_state), dir the absolute
+    // direction of the worm. Returns the new absolute direction, or -1 if the worm dies.
+    template<int RuleLength = 0>
+    inline int next(int state, int dir, const std::vector<int>& rule, int* visited_state, size_t& total_visited_state) {
+        signed char& entry = next_dir[dir << 6 | state];
+        if (entry == unknown) {
+            phase_stats[PHASE_RULE_QUERY].count++;
+            int turn = query_state<RuleLength>(rotate_right(state, 6, dir), rule, visited_state, total_visited_state);
+            entry = turn == -1 ? -1 : (dir + turn) % 6;
+        }
+        return entry;
+    }
+};
@@ -0,0 +1,39 @@
+#include <algorithm>
+#include "rule.h"
+#include "run-stats.h"
+
+void add_run_stats(RunStats& into, const RunStats& other) {
+    into.edges += other.edges;
+    into.cells += other.cells;
+    into.min_row = std::min(into.min_row, other.min_row);
+    into.min_col = std::min(into.min_col, other.min_col);
+    into.max_row = std::max(into.max_row, other.max_row);
+    into.max_col = std::max(into.max_col, other.max_col);
+    into.deaths += other.deaths;
+    into.last_death = std::max(into.last_death, other.last_death);
+    for (int i = 0; i < (6 << 6); ++i) into.reads[i] += other.reads[i];
+}
+
+void write_run_stats_header(std::ostream& out) {
+    out << "# step edges cells min-row min-col max-row max-col deaths last-death seconds";
+    for (int i = 0; i < (1 << 5); ++i) out << " state-" << i;
+    out << '\n';
+}
+
+void write_run_stats(std::ostream& out, unsigned long step, double seconds, const RunStats& stats) {
+    bool empty = stats.min_row > stats.max_row;
+    out << step << ' ' << stats.edges << ' ' << stats.cells << ' ';
+    if (empty) {
+        out << "-1 -1 -1 -1";
+    } else {
+        out << stats.min_row << ' ' << stats.min_col << ' ' << stats.max_row << ' ' << stats.max_col;
+    }
+    out << ' ' << stats.deaths << ' ' << stats.last_death << ' ' << seconds;
+    unsigned long histogram[1 << 5] = {};
+    for (int dir = 0; dir < 6; ++dir)
+    for (int state = 0; state < (1 << 6); ++state) {
+        histogram[reduce_state(rotate_right(state, 6, dir))] += stats.reads[dir << 6 | state];
+    }
+    for (auto count: histogram) out << ' ' << count;
+    out << std::endl;
+}
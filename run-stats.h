@@ -0,0 +1,65 @@
+#pragma once
+#include <climits>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+// The cells of a box (a region, or the whole board) where a worm has read its state, one bit
+// each, so every cell is counted once however often it is visited.
+class VisitedCells {
+    std::vector<uint64_t> bits;
+    size_t width = 0;
+public:
+    void reset(size_t height, size_t width_) {
+        width = width_;
+        bits.assign((height * width + 63) / 64, 0);
+    }
+    bool empty() const { return bits.empty(); }
+
+    // whether the cell had not been visited, it is now.
+    inline bool visit(size_t row, size_t col) {
+        size_t index = row * width + col;
+        uint64_t& word = bits[index >> 6];
+        uint64_t bit = (uint64_t)1 << (index & 63);
+        bool first = !(word & bit);
+        word |= bit;
+        return first;
+    }
+};
+
+// The vital signs of a run (see --metrics), counted by the engines as the worms move, so they
+// can be followed without the board. Each process counts the steps it does; the counts of
+// the processes are put together with add_run_stats.
+struct RunStats {
+    // the steps, each drawing one edge, and the cells a worm has read its state in, each
+    // counted at its first visit (see VisitedCells).
+    unsigned long edges = 0, cells = 0;
+    // the box of the cells where a worm has read its state, empty while min_row > max_row.
+    long min_row = LONG_MAX, min_col = LONG_MAX, max_row = LONG_MIN, max_col = LONG_MIN;
+    // the worms that died, and the steps before the last of them died, -1 for none.
+    unsigned long deaths = 0;
+    long last_death = -1;
+    // how many times each (direction << 6 | state) was read, the state as given by get_state.
+    unsigned long reads[6 << 6] = {};
+
+    inline void read(int row, int col, int dir, int state, bool first_visit) {
+        ++reads[dir << 6 | state];
+        if (first_visit) ++cells;
+        if (row < min_row) min_row = row;
+        if (row > max_row) max_row = row;
+        if (col < min_col) min_col = col;
+        if (col > max_col) max_col = col;
+    }
+    inline void step() { ++edges; }
+    inline void death(unsigned long step) {
+        ++deaths;
+        if ((long)step > last_death) last_death = step;
+    }
+};
+
+void add_run_stats(RunStats& into, const RunStats& other);
+
+// One line of the time series, after the given steps and seconds. The reads are put
+// together by the state bound to the rule (see reduce_state).
+void write_run_stats_header(std::ostream& out);
+void write_run_stats(std::ostream& out, unsigned long step, double seconds, const RunStats& stats);
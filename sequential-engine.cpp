@@ -0,0 +1,100 @@
+#include <algorithm>
+#include "ascii-codec.h"
+#include "sequential-engine.h"
+#include "utils.h"
+
+SequentialGame::SequentialGame(const GameInfo& game_, const std::vector<int>& rule_,
+                               const int* visited_state_, size_t total_visited_state_)
+    : game(game_)
+    , rule(rule_)
+    , total_visited_state(total_visited_state_)
+    , cells(game.height * game.width)
+{
+    std::copy(visited_state_, visited_state_ + (1 << 5), visited_state);
+}
+
+void SequentialGame::read_board(const std::vector<std::string>& board_ascii) {
+    for (size_t r = 0; r < game.height; ++r) {
+        decode_ascii_row(board_ascii[r * 2].data(), board_ascii[r * 2 + 1].data(), game.width, &cells[r * game.width]);
+    }
+}
+
+void SequentialGame::write_board(std::vector<std::string>& board_ascii) const {
+    for (size_t r = 0; r < game.height; ++r) {
+        encode_ascii_row(&cells[r * game.width], game.width, &board_ascii[r * 2][0], &board_ascii[r * 2 + 1][0]);
+    }
+}
+
+unsigned long SequentialGame::run() {
+    PhaseTimer timer(PHASE_STEP);
+    transitions.reset();
+    if (!run_stats) return run_rule<false>();
+    if (visited.empty()) visited.reset(game.height, game.width);
+    return run_rule<true>();
+}
+
+// the common rule lengths get their own copy of the loop, so the rule size is a constant
+// when a new state is bound.
+template<bool Stats>
+unsigned long SequentialGame::run_rule() {
+    switch (rule.size()) {
+    case 1: return run_kernel<1, Stats>();
+    case 2: return run_kernel<2, Stats>();
+    case 3: return run_kernel<3, Stats>();
+    case 4: return run_kernel<4, Stats>();
+    case 5: return run_kernel<5, Stats>();
+    case 6: return run_kernel<6, Stats>();
+    case 7: return run_kernel<7, Stats>();
+    case 8: return run_kernel<8, Stats>();
+    default: return run_kernel<0, Stats>();
+    }
+}
+
+template<int RuleLength, bool Stats>
+unsigned long SequentialGame::run_kernel() {
+    const int height = game.height;
+    const int width = game.width;
+    char* board = cells.data();
+    int row = game.worm.row, col = game.worm.col, dir = game.worm.dir;
+    unsigned long step = 0;
+    if (trajectory) trajectory->sync(steps_done, row, col, dir);
+    for (; step < game.iteration_count; ++step) {
+        int up = row ? row - 1 : height - 1;
+        int left = col ? col - 1 : width - 1;
+        char* cur = board + row * width + col;
+        int state = *cur
+            | (board[row * width + left] & 1) << 3
+            | (board[up * width + left] >> 1 & 1) << 4
+            | (board[up * width + col] >> 2 & 1) << 5;
+        int new_dir = transitions.next<RuleLength>(state, dir, rule, visited_state, total_visited_state);
+        if (Stats) run_stats->read(row, col, dir, state, visited.visit(row, col));
+        if (new_dir == -1) {
+            if (Stats) run_stats->death(steps_done + step);
+            dir = -1;
+            break;
+        }
+        int turn = new_dir - dir;
+        dir = new_dir;
+        row += dr[dir];
+        col += dc[dir];
+        if (row < 0) row += height;
+        if (row >= height) row -= height;
+        if (col < 0) col += width;
+        if (col >= width) col -= width;
+        // the edge belongs to the cell it goes from in the directions 0, 1 and 2.
+        if (dir < 3) {
+            *cur |= 1 << dir;
+        } else {
+            board[row * width + col] |= 1 << opposite_dir[dir];
+        }
+        if (trajectory) trajectory->record(turn < 0 ? turn + 6 : turn, row, col, dir);
+        if (Stats) run_stats->step();
+    }
+    game.worm.row = row;
+    game.worm.col = col;
+    game.worm.dir = dir;
+    game.iteration_count -= step;
+    steps_done += step;
+    phase_stats[PHASE_CELL_UPDATE].count += step;
+    return step;
+}
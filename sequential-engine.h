@@ -0,0 +1,45 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "state.h"
+#include "rule.h"
+#include "run-stats.h"
+#include "trajectory.h"
+
+// The whole board in one process, for the runs that fit in one node. It is a flat array of
+// cells (in the same format as ChessBoardRegion's) with the torus wrapping done in place,
+// so a step is only a few loads, a lookup in the transition table and a store.
+class SequentialGame {
+    TransitionTable transitions;
+    // the cells read so far, for run_stats.
+    VisitedCells visited;
+
+    // Stats is whether run_stats is set, so the loop without them does not test it.
+    template<bool Stats>
+    unsigned long run_rule();
+    template<int RuleLength, bool Stats>
+    unsigned long run_kernel();
+public:
+    GameInfo game;
+    std::vector<int> rule;
+    size_t total_visited_state;
+    int visited_state[1 << 5];
+    std::vector<char> cells;
+    // every step is recorded there if it is set.
+    TrajectoryLog* trajectory = nullptr;
+    // the same for the run stats.
+    RunStats* run_stats = nullptr;
+    // the steps done by all the runs so far.
+    unsigned long steps_done = 0;
+
+    SequentialGame(const GameInfo& game_, const std::vector<int>& rule_,
+                   const int* visited_state_, size_t total_visited_state_);
+
+    void read_board(const std::vector<std::string>& board_ascii);
+    void write_board(std::vector<std::string>& board_ascii) const;
+
+    // Moves the worm until it dies or game.iteration_count is exhausted,
+    // returns the number of steps done. The rule may be changed between the runs.
+    unsigned long run();
+};
@@ -0,0 +1,485 @@
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <map>
+#include <unordered_set>
+#include "sparse-engine.h"
+#include "trace.h"
+
+const char SparseBoard::empty_tile[tile_size * tile_size] = {};
+
+// the number of steps from `pos` by `move` before leaving [start, end), with start <= pos < end.
+static int64_t steps_inside(int64_t pos, int64_t move, int64_t start, int64_t end) {
+    if (move > 0) return (end - 1 - pos) / move;
+    if (move < 0) return (pos - start) / -move;
+    return LLONG_MAX;
+}
+
+// the first j from which pos + j * move stays out of [low, high].
+static int64_t steps_to_pass(int64_t pos, int64_t move, int64_t low, int64_t high) {
+    if (move > 0) return pos > high ? 0 : (high - pos) / move + 1;
+    if (move < 0) return pos < low ? 0 : (pos - low) / -move + 1;
+    return LLONG_MAX;
+}
+
+static int64_t floor_div(int64_t a, int64_t b) {
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+// narrows [first, last] to the m for which pos + m * move is in [low, high].
+static void clip_range(int64_t pos, int64_t move, int64_t low, int64_t high, int64_t& first, int64_t& last) {
+    if (move < 0) {
+        pos = -pos;
+        move = -move;
+        std::swap(low, high);
+        low = -low;
+        high = -high;
+    }
+    if (move == 0) {
+        if (pos < low || pos > high) last = first - 1;
+        return;
+    }
+    first = std::max(first, -floor_div(pos - low, move));
+    last = std::min(last, floor_div(high - pos, move));
+}
+
+// Calls visit(first, last, top, left, bottom, right) for the runs [first, last] of the m from
+// `from` to `to` over which the box of cells moved by m * (move_row, move_col) covers the
+// same tiles, the tile rows top to bottom and the tile columns left to right. On the plane;
+// stops when visit returns false.
+template<class Visit>
+static void for_each_tile_run(int64_t top, int64_t left, int64_t bottom, int64_t right,
+                              int64_t move_row, int64_t move_col, int64_t from, int64_t to, Visit visit) {
+    const int bits = SparseBoard::tile_bits;
+    for (int64_t m = from; m <= to; ) {
+        int64_t box[4] = {top + m * move_row, bottom + m * move_row, left + m * move_col, right + m * move_col};
+        int64_t run = to - m;
+        for (int i = 0; i < 4; ++i) {
+            int64_t start = box[i] >> bits << bits;
+            run = std::min(run, steps_inside(box[i], i < 2 ? move_row : move_col, start, start + SparseBoard::tile_size));
+        }
+        if (!visit(m, m + run, box[0] >> bits, box[2] >> bits, box[1] >> bits, box[3] >> bits)) return;
+        m += run + 1;
+    }
+}
+
+char* SparseBoard::find_tile(uint64_t key) {
+    auto it = tiles.find(key);
+    if (it != tiles.end()) return it->second.get();
+    if (pending.empty() || !pending.count(key)) return nullptr;
+    return make_tile(key);
+}
+
+char* SparseBoard::make_tile(uint64_t key) {
+    Tile& tile = tiles[key];
+    if (!tile) {
+        tile = Tile(new char[tile_size * tile_size]());
+        auto it = pending.empty() ? pending.end() : pending.find(key);
+        if (it != pending.end()) {
+            for (int id: it->second) draw_stamp(stamps[id], key, tile.get());
+            pending.erase(it);
+        }
+    }
+    return tile.get();
+}
+
+void SparseBoard::draw_stamp(const Stamp& stamp, uint64_t key, char* tile) {
+    int64_t top = (int64_t)(int32_t)(key >> 32) * tile_size;
+    int64_t left = (int64_t)(int32_t)(key & 0xFFFFFFFF) * tile_size;
+    const int64_t stride = stamp.move_row * tile_size + stamp.move_col;
+    for (auto& edge: stamp.edges) {
+        int64_t row = stamp.row + edge.row, col = stamp.col + edge.col;
+        int64_t first = 1, last = stamp.count;
+        clip_range(row, stamp.move_row, top, top + tile_mask, first, last);
+        clip_range(col, stamp.move_col, left, left + tile_mask, first, last);
+        if (first > last) continue;
+        size_t index = index_in_tile(row + first * stamp.move_row, col + first * stamp.move_col);
+        for (int64_t m = first; m <= last; ++m, index += stride) {
+            tile[index] |= edge.bits;
+        }
+    }
+}
+
+void SparseBoard::stamp(int64_t row, int64_t col, int64_t move_row, int64_t move_col, int64_t count,
+                        std::vector<StampEdge> edges) {
+    if (count <= 0 || edges.empty()) return;
+    int64_t top = LLONG_MAX, left = LLONG_MAX, bottom = LLONG_MIN, right = LLONG_MIN;
+    for (auto& edge: edges) {
+        top = std::min(top, edge.row);
+        bottom = std::max(bottom, edge.row);
+        left = std::min(left, edge.col);
+        right = std::max(right, edge.col);
+    }
+    Stamp added = {row, col, move_row, move_col, count, std::move(edges),
+                   row + top + std::min(move_row, count * move_row), col + left + std::min(move_col, count * move_col),
+                   row + bottom + std::max(move_row, count * move_row), col + right + std::max(move_col, count * move_col)};
+    int id = stamps.size();
+    stamps.push_back(std::move(added));
+    std::unordered_set<uint64_t> drawn;
+    for_each_tile_run(row + top, col + left, row + bottom, col + right, move_row, move_col, 1, count,
+                      [&](int64_t, int64_t, int64_t tile_top, int64_t tile_left, int64_t tile_bottom, int64_t tile_right) {
+        for (int64_t r = tile_top; r <= tile_bottom; ++r)
+        for (int64_t c = tile_left; c <= tile_right; ++c) {
+            uint64_t key = key_of_tile(r, c);
+            auto it = tiles.find(key);
+            if (it != tiles.end()) {
+                if (drawn.insert(key).second) draw_stamp(stamps[id], key, it->second.get());
+                continue;
+            }
+            std::vector<int>& ids = pending[key];
+            if (ids.empty() || ids.back() != id) ids.push_back(id);
+        }
+        return true;
+    });
+}
+
+bool SparseBoard::bounds(int64_t& top, int64_t& left, int64_t& bottom, int64_t& right) const {
+    bool found = false;
+    for (auto& it: tiles) {
+        int64_t tile_row = (int64_t)(int32_t)(it.first >> 32) * tile_size;
+        int64_t tile_col = (int64_t)(int32_t)(it.first & 0xFFFFFFFF) * tile_size;
+        const char* tile = it.second.get();
+        for (int64_t r = 0; r < tile_size; ++r)
+        for (int64_t c = 0; c < tile_size; ++c) {
+            if (!tile[r << tile_bits | c]) continue;
+            if (!found) {
+                top = bottom = tile_row + r;
+                left = right = tile_col + c;
+                found = true;
+            }
+            top = std::min(top, tile_row + r);
+            bottom = std::max(bottom, tile_row + r);
+            left = std::min(left, tile_col + c);
+            right = std::max(right, tile_col + c);
+        }
+    }
+    // the tiles a stamp has not been drawn into yet.
+    for (auto& stamp: stamps) {
+        if (!found) {
+            top = stamp.top;
+            left = stamp.left;
+            bottom = stamp.bottom;
+            right = stamp.right;
+            found = true;
+        }
+        top = std::min(top, stamp.top);
+        bottom = std::max(bottom, stamp.bottom);
+        left = std::min(left, stamp.left);
+        right = std::max(right, stamp.right);
+    }
+    return found;
+}
+
+SparseGame::SparseGame(const GameInfo& game_, bool infinite_, const std::vector<int>& rule_,
+                       const int* visited_state_, size_t total_visited_state_)
+    : game(game_)
+    , infinite(infinite_)
+    , row(game.worm.row)
+    , col(game.worm.col)
+    , rule(rule_)
+    , total_visited_state(total_visited_state_)
+{
+    std::copy(visited_state_, visited_state_ + (1 << 5), visited_state);
+}
+
+void SparseGame::read_board(const std::vector<std::string>& board_ascii) {
+    for (size_t r = 0; r < game.height; ++r)
+    for (size_t c = 0; c < game.width; ++c) {
+        const std::string& even = board_ascii[r * 2];
+        const std::string& odd = board_ascii[r * 2 + 1];
+        char cur = 0;
+        cur = cur << 1 | (odd[c * 2] == '|');
+        cur = cur << 1 | (odd[c * 2 + 1] == '\\');
+        cur = cur << 1 | (even[c * 2 + 1] == '=');
+        // an empty cell needs no tile.
+        if (cur) board.at(r, c) = cur;
+    }
+}
+
+void SparseGame::write_board(std::vector<std::string>& board_ascii, int64_t top, int64_t left,
+                             int64_t height, int64_t width) {
+    for (int64_t r = 0; r < height; ++r)
+    for (int64_t c = 0; c < width; ++c) {
+        std::string& even = board_ascii[r * 2];
+        std::string& odd = board_ascii[r * 2 + 1];
+        int cur = board.get(top + r, left + c);
+        even[c * 2] = '*';
+        odd[c * 2] = GETBIT(cur, 2) ? '|' : ' ';
+        odd[c * 2 + 1] = GETBIT(cur, 1) ? '\\' : ' ';
+        even[c * 2 + 1] = GETBIT(cur, 0) ? '=' : ' ';
+    }
+}
+
+inline int SparseGame::get_state(int64_t row, int64_t col, int64_t up, int64_t left) {
+    return board.get(row, col)
+        | (board.get(row, left) & 1) << 3
+        | (board.get(up, left) >> 1 & 1) << 4
+        | (board.get(up, col) >> 2 & 1) << 5;
+}
+
+unsigned long SparseGame::run() {
+    PhaseTimer timer(PHASE_STEP);
+    transitions.reset();
+    const int64_t height = game.height;
+    const int64_t width = game.width;
+    int dir = game.worm.dir;
+    unsigned long step = 0;
+    if (trajectory) trajectory->sync(steps_done, row, col, dir);
+    for (; step < game.iteration_count; ++step) {
+        int64_t up = row - 1, left = col - 1;
+        if (!infinite) {
+            if (up < 0) up += height;
+            if (left < 0) left += width;
+        }
+        int state;
+        const char* tile = board.tile_of(row, col);
+        if (tile && (row & SparseBoard::tile_mask) && (col & SparseBoard::tile_mask)) {
+            // the neighbours are in the same tile.
+            const char* cur = tile + ((row & SparseBoard::tile_mask) << SparseBoard::tile_bits | (col & SparseBoard::tile_mask));
+            state = *cur
+                | (cur[-1] & 1) << 3
+                | (cur[-SparseBoard::tile_size - 1] >> 1 & 1) << 4
+                | (cur[-SparseBoard::tile_size] >> 2 & 1) << 5;
+        } else {
+            state = get_state(row, col, up, left);
+        }
+        int new_dir = transitions.next(state, dir, rule, visited_state, total_visited_state);
+        if (new_dir == -1) {
+            dir = -1;
+            break;
+        }
+        int turn = new_dir - dir;
+        dir = new_dir;
+        int64_t from_row = row, from_col = col;
+        row += dr[dir];
+        col += dc[dir];
+        if (!infinite) {
+            if (row < 0) row += height;
+            if (row >= height) row -= height;
+            if (col < 0) col += width;
+            if (col >= width) col -= width;
+        }
+        // the edge belongs to the cell it goes from in the directions 0, 1 and 2.
+        if (dir < 3) {
+            board.at(from_row, from_col) |= 1 << dir;
+        } else {
+            board.at(row, col) |= 1 << opposite_dir[dir];
+        }
+        if (trajectory) trajectory->record(turn < 0 ? turn + 6 : turn, row, col, dir);
+        if (fast_forward) {
+            history.push(dir);
+            if (history.size() == next_check) {
+                unsigned long skipped = skip_periods(game.iteration_count - step - 1);
+                step += skipped;
+                // the searches get rarer while the worm does not repeat itself.
+                check_interval = skipped ? MoveHistory::check_interval
+                                         : std::min(2 * check_interval, MoveHistory::max_check_interval);
+                next_check = history.size() + check_interval;
+            }
+        }
+    }
+    game.worm.row = row;
+    game.worm.col = col;
+    game.worm.dir = dir;
+    game.iteration_count -= step;
+    steps_done += step;
+    phase_stats[PHASE_CELL_UPDATE].count += step;
+    return step;
+}
+
+// The last p moves (the period 0) went by D. The period m repeats the period m - 1 if every
+// cell x read in the period 0 (from the worm now) has the same edges, for the bits read, at
+// x + m * D as at x + (m - 1) * D one period earlier. With B the board now and W the edges
+// drawn in the period 0, that is
+//     B(x + D) == B(x) - W(x)                                     for m = 1,
+//     B(x + m * D) | U == B(x + (m - 1) * D) | U                    for m >= 2,
+// with U = W(x + D) | ... | W(x + (m - 1) * D). Far from W, U stops changing and both sides
+// are empty where the board is, so the tiles that do not exist are crossed at once.
+//
+// On the plane, the periods first read the tiles around the worm, then only empty cells
+// until they meet a tile again. Only that first run of periods (and the one after it) is
+// checked cell by cell, the skip stops before the next tile, and the periods are drawn as
+// one stamp (see SparseBoard::stamp): a skip costs about one step per tile it crosses.
+unsigned long SparseGame::skip_periods(unsigned long budget) {
+    PhaseTimer timer(PHASE_FAST_FORWARD);
+    int period = history.find_period();
+    if (!period || budget < (unsigned long)period) return 0;
+    const int64_t move_row = history.row_at(0) - history.row_at(period);
+    const int64_t move_col = history.col_at(0) - history.col_at(period);
+
+    // the bits read and the edges drawn in the period 0.
+    std::map<std::pair<int64_t, int64_t>, int> reads, writes;
+    for (int back = period; back > 0; --back) {
+        int64_t r = history.row_at(back) - history.row_at(0);
+        int64_t c = history.col_at(back) - history.col_at(0);
+        int d = history.dir_at(back - 1);
+        reads[{r, c}] |= 7;
+        reads[{r, c - 1}] |= 1;
+        reads[{r - 1, c - 1}] |= 2;
+        reads[{r - 1, c}] |= 4;
+        if (d < 3) {
+            writes[{r, c}] |= 1 << d;
+        } else {
+            writes[{r + dr[d], c + dc[d]}] |= 1 << opposite_dir[d];
+        }
+    }
+    int64_t read_top = LLONG_MAX, read_left = LLONG_MAX, read_bottom = LLONG_MIN, read_right = LLONG_MIN;
+    for (auto& it: reads) {
+        read_top = std::min(read_top, it.first.first);
+        read_bottom = std::max(read_bottom, it.first.first);
+        read_left = std::min(read_left, it.first.second);
+        read_right = std::max(read_right, it.first.second);
+    }
+    int64_t write_top = LLONG_MAX, write_left = LLONG_MAX, write_bottom = LLONG_MIN, write_right = LLONG_MIN;
+    for (auto& it: writes) {
+        write_top = std::min(write_top, it.first.first);
+        write_bottom = std::max(write_bottom, it.first.first);
+        write_left = std::min(write_left, it.first.second);
+        write_right = std::max(write_right, it.first.second);
+    }
+
+    int64_t periods = budget / period;
+    if (!infinite) {
+        // the periods must not meet around the torus, the offsets below are not wrapped.
+        auto limit = [](int64_t span, int64_t move, int64_t size) -> int64_t {
+            if (span >= size) return 0;
+            if (!move) return LLONG_MAX;
+            return (size - 1 - span) / std::abs(move);
+        };
+        int64_t top = std::min(read_top, write_top), bottom = std::max(read_bottom, write_bottom);
+        int64_t left = std::min(read_left, write_left), right = std::max(read_right, write_right);
+        periods = std::min({periods, limit(bottom - top, move_row, game.height),
+                            limit(right - left, move_col, game.width)});
+    }
+    if (!periods) return 0;
+
+    auto cell = [&](int64_t r, int64_t c) -> int {
+        return board.get(wrap(row + r, game.height), wrap(col + c, game.width));
+    };
+    auto drawn = [&](int64_t r, int64_t c) -> int {
+        auto it = writes.find({r, c});
+        return it == writes.end() ? 0 : it->second;
+    };
+    // on the plane, the runs of periods whose reads meet a tile (or not), from the period `from`.
+    auto reach_tiles = [&](int64_t from, bool reached, int64_t& end) {
+        end = periods + 1;
+        for_each_tile_run(row + read_top, col + read_left, row + read_bottom, col + read_right,
+                          move_row, move_col, from, periods,
+                          [&](int64_t first, int64_t, int64_t top, int64_t left, int64_t bottom, int64_t right) {
+            bool found = false;
+            for (int64_t r = top; r <= bottom && !found; ++r)
+            for (int64_t c = left; c <= right && !found; ++c) {
+                found = board.has_tile(r, c);
+            }
+            if (found == reached) return true;
+            end = first;
+            return false;
+        });
+    };
+    // the last period checked cell by cell.
+    int64_t exact_last = periods;
+    if (infinite) {
+        reach_tiles(2, true, exact_last);
+        exact_last = std::min(exact_last, periods);
+    }
+
+    struct Ray {
+        int64_t row, col;
+        int mask;
+        // W(x + j * D) is empty from j = near.
+        int64_t near;
+        // U, and the cell in the period before.
+        int drawn, before;
+    };
+    std::vector<Ray> rays;
+    for (auto& it: reads) {
+        int64_t r = it.first.first, c = it.first.second;
+        int after = cell(r + move_row, c + move_col);
+        if ((after ^ (cell(r, c) & ~drawn(r, c))) & it.second) return 0;
+        rays.push_back({r, c, it.second, std::min(steps_to_pass(r, move_row, write_top, write_bottom),
+                                                  steps_to_pass(c, move_col, write_left, write_right)), 0, after});
+    }
+
+    // the periods are checked by chunks, growing while nothing is found. In a chunk, the cells
+    // of a ray are read one after the other, tile by tile.
+    const int64_t stride = move_row * SparseBoard::tile_size + move_col;
+    for (int64_t first = 2, chunk = 64; first <= exact_last; first += chunk, chunk *= 2) {
+        for (auto& x: rays) {
+            int64_t last = std::min(exact_last, first + chunk - 1);
+            for (int64_t m = first; m <= last; ) {
+                int64_t cur_row = wrap(row + x.row + m * move_row, game.height);
+                int64_t cur_col = wrap(col + x.col + m * move_col, game.width);
+                // the cells of the ray up to the end of the tile (or of the torus), or only this one
+                // while U changes.
+                int64_t end = m;
+                if (m - 1 < x.near) {
+                    x.drawn |= drawn(x.row + (m - 1) * move_row, x.col + (m - 1) * move_col);
+                } else {
+                    int64_t tile_top = cur_row >> SparseBoard::tile_bits << SparseBoard::tile_bits;
+                    int64_t tile_left = cur_col >> SparseBoard::tile_bits << SparseBoard::tile_bits;
+                    int64_t tile_bottom = tile_top + SparseBoard::tile_size;
+                    int64_t tile_right = tile_left + SparseBoard::tile_size;
+                    if (!infinite) {
+                        tile_bottom = std::min(tile_bottom, (int64_t)game.height);
+                        tile_right = std::min(tile_right, (int64_t)game.width);
+                    }
+                    end = m + std::min({last - m, steps_inside(cur_row, move_row, tile_top, tile_bottom),
+                                        steps_inside(cur_col, move_col, tile_left, tile_right)});
+                    // the cells of a tile that does not exist are empty.
+                    if (!x.before && !board.has_tile(cur_row >> SparseBoard::tile_bits, cur_col >> SparseBoard::tile_bits)) {
+                        m = end + 1;
+                        continue;
+                    }
+                }
+                const char* tile = board.tile_of(cur_row, cur_col);
+                size_t index = SparseBoard::index_in_tile(cur_row, cur_col);
+                for (; m <= end; ++m, index += stride) {
+                    int now = tile ? tile[index] : 0;
+                    if ((now ^ x.before) & x.mask & ~x.drawn) break;
+                    x.before = now;
+                }
+                if (m <= end) {
+                    periods = m - 1;
+                    exact_last = std::min(exact_last, periods);
+                    break;
+                }
+            }
+        }
+    }
+
+    if (infinite && periods > exact_last) {
+        // past the last period checked, the skip stops before the reads meet a tile again.
+        int64_t end;
+        reach_tiles(exact_last + 1, false, end);
+        periods = end - 1;
+    }
+    if (!periods) return 0;
+
+    if (infinite) {
+        std::vector<SparseBoard::StampEdge> edges;
+        for (auto& it: writes) edges.push_back({it.first.first, it.first.second, it.second});
+        board.stamp(row, col, move_row, move_col, periods, std::move(edges));
+    } else {
+        // the skip is at most the size of the torus, the edges are drawn as they are.
+        std::vector<std::pair<std::pair<int64_t, int64_t>, int>> edges(writes.begin(), writes.end());
+        for (int64_t m = 1; m <= periods; ++m)
+        for (auto& it: edges) {
+            board.at(wrap(row + it.first.first + m * move_row, game.height),
+                     wrap(col + it.first.second + m * move_col, game.width)) |= it.second;
+        }
+    }
+    if (trajectory) {
+        for (int64_t m = 1; m <= periods; ++m)
+        for (int back = period - 1; back >= 0; --back) {
+            int turn = (history.dir_at(back) - history.dir_at(back + 1) + 6) % 6;
+            int64_t r = history.row_at(back) - history.row_at(0) + m * move_row;
+            int64_t c = history.col_at(back) - history.col_at(0) + m * move_col;
+            trajectory->record(turn, wrap(row + r, game.height), wrap(col + c, game.width), history.dir_at(back));
+        }
+    }
+    row = wrap(row + periods * move_row, game.height);
+    col = wrap(col + periods * move_col, game.width);
+    history.clear();
+    steps_skipped += periods * period;
+    return periods * period;
+}
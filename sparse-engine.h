@@ -0,0 +1,159 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "state.h"
+#include "rule.h"
+#include "trajectory.h"
+#include "period.h"
+
+// A board that only keeps the tiles of cells that have an edge or have been visited,
+// so the memory follows the area the worm has explored instead of the size of the board.
+// The cells are in the same format as ChessBoardRegion's.
+class SparseBoard {
+public:
+    static const int tile_bits = 6;
+    static const int64_t tile_size = 1 << tile_bits;
+    static const int64_t tile_mask = tile_size - 1;
+    typedef std::unique_ptr<char[]> Tile;
+    // an edge of a stamp, from its origin.
+    struct StampEdge {
+        int64_t row, col;
+        int bits;
+    };
+private:
+    // Edges drawn again and again: the edges at origin + m * move, for m from 1 to count.
+    struct Stamp {
+        int64_t row, col, move_row, move_col, count;
+        std::vector<StampEdge> edges;
+        // the smallest box holding every edge drawn.
+        int64_t top, left, bottom, right;
+    };
+    std::unordered_map<uint64_t, Tile> tiles;
+    std::vector<Stamp> stamps;
+    // the stamps drawing into the tiles that do not exist yet, drawn when the tile is made.
+    std::unordered_map<uint64_t, std::vector<int>> pending;
+    // the last tile found, most steps stay in it.
+    uint64_t last_key = ~(uint64_t)0;
+    char* last_tile = nullptr;
+    // read in place of the tiles that do not exist.
+    static const char empty_tile[tile_size * tile_size];
+
+    static uint64_t key_of_tile(int64_t tile_row, int64_t tile_col) {
+        return (uint64_t)(uint32_t)tile_row << 32 | (uint32_t)tile_col;
+    }
+    static uint64_t key_of(int64_t row, int64_t col) {
+        return key_of_tile(row >> tile_bits, col >> tile_bits);
+    }
+    // the tile, nullptr if it does not exist and no stamp draws into it.
+    char* find_tile(uint64_t key);
+    // the tile, created if it does not exist.
+    char* make_tile(uint64_t key);
+    void draw_stamp(const Stamp& stamp, uint64_t key, char* tile);
+public:
+    static size_t index_in_tile(int64_t row, int64_t col) {
+        return (row & tile_mask) << tile_bits | (col & tile_mask);
+    }
+
+    // the tile of the cell, nullptr if it does not exist.
+    inline const char* tile_of(int64_t row, int64_t col) {
+        uint64_t key = key_of(row, col);
+        if (key == last_key) return last_tile;
+        char* tile = find_tile(key);
+        if (tile) {
+            last_key = key;
+            last_tile = tile;
+        }
+        return tile;
+    }
+
+    inline char get(int64_t row, int64_t col) {
+        const char* tile = tile_of(row, col);
+        return tile ? tile[index_in_tile(row, col)] : 0;
+    }
+
+    // the cell, with its tile created if needed.
+    inline char& at(int64_t row, int64_t col) {
+        uint64_t key = key_of(row, col);
+        if (key != last_key) {
+            last_tile = make_tile(key);
+            last_key = key;
+        }
+        return last_tile[index_in_tile(row, col)];
+    }
+
+    size_t tile_count() const { return tiles.size(); }
+
+    // whether the tile (of tile_size x tile_size cells) exists or a stamp draws into it,
+    // otherwise its cells are empty.
+    bool has_tile(int64_t tile_row, int64_t tile_col) const {
+        uint64_t key = key_of_tile(tile_row, tile_col);
+        return tiles.count(key) || (!pending.empty() && pending.count(key));
+    }
+
+    // Draws the edges at (row + r + m * move_row, col + c + m * move_col) for every m from 1
+    // to count, on the plane. Only the tiles that exist are drawn now, the others when they
+    // are made, so a long run of the same moves costs about one step per tile it crosses.
+    void stamp(int64_t row, int64_t col, int64_t move_row, int64_t move_col, int64_t count,
+               std::vector<StampEdge> edges);
+
+    // The smallest box holding every cell with an edge, false if there is none.
+    bool bounds(int64_t& top, int64_t& left, int64_t& bottom, int64_t& right) const;
+};
+
+// Like SequentialGame, on a SparseBoard. The board is either the torus of the state file,
+// or (when infinite) the plane with the board of the state file at (0, 0) and no edge elsewhere.
+class SparseGame {
+    TransitionTable transitions;
+    SparseBoard board;
+    MoveHistory history;
+
+    // the state of the cell, as given by ChessBoardRegion::get_state.
+    int get_state(int64_t row, int64_t col, int64_t up, int64_t left);
+    // the coordinate on the board, which is the plane or the torus.
+    inline int64_t wrap(int64_t value, int64_t size) const {
+        if (infinite) return value;
+        value %= size;
+        return value < 0 ? value + size : value;
+    }
+    // Repeats the last moves of the worm as many times as they are sure to repeat, up to
+    // `budget` steps. Returns the number of steps done.
+    unsigned long skip_periods(unsigned long budget);
+    // the steps until the next search for the periods, longer while none is found, and the
+    // size of the history at that search.
+    unsigned long check_interval = MoveHistory::check_interval;
+    unsigned long next_check = MoveHistory::check_interval;
+public:
+    GameInfo game;
+    bool infinite;
+    // the worm, which can go anywhere on the plane.
+    int64_t row, col;
+    std::vector<int> rule;
+    size_t total_visited_state;
+    int visited_state[1 << 5];
+    TrajectoryLog* trajectory = nullptr;
+    unsigned long steps_done = 0;
+    // look for the moves the worm repeats and skip them (see skip_periods).
+    bool fast_forward = false;
+    // the steps done by skip_periods, counted in steps_done as well.
+    unsigned long steps_skipped = 0;
+
+    SparseGame(const GameInfo& game_, bool infinite_, const std::vector<int>& rule_,
+               const int* visited_state_, size_t total_visited_state_);
+
+    void read_board(const std::vector<std::string>& board_ascii);
+    // The cells of the box of the given size from (top, left).
+    void write_board(std::vector<std::string>& board_ascii, int64_t top, int64_t left,
+                     int64_t height, int64_t width);
+
+    size_t tile_count() const { return board.tile_count(); }
+    bool bounds(int64_t& top, int64_t& left, int64_t& bottom, int64_t& right) const {
+        return board.bounds(top, left, bottom, right);
+    }
+
+    // Moves the worm until it dies or game.iteration_count is exhausted,
+    // returns the number of steps done.
+    unsigned long run();
+};
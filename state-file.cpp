@@ -0,0 +1,149 @@
+#include <fstream>
+#include "state-file.h"
+
+// the bindings of a worm, or of all of them when they are shared.
+static std::string read_bindings(std::istream& inp, int* visited, size_t& total) {
+    for (int i = 0; i < (1 << 5); ++i) {
+        visited[i] = -1;
+    }
+    if (!(inp >> total)) return "Cannot read <number-of-visited-state>";
+    if (total > (1 << 5)) return "There are only 32 states";
+    for (size_t i = 0; i < total; ++i) {
+        int cur_state;
+        if (!(inp >> cur_state)) return "Cannot read <visited-state-" + std::to_string(i) + ">";
+        if (cur_state < 0 || cur_state >= (1 << 5)) return "The visited state must be between 0 and 31";
+        visited[cur_state] = i;
+    }
+    return "";
+}
+
+std::string read_state_header(std::istream& inp, GameInfo& game, std::vector<int>& rule,
+        int* visited_state, size_t& total_visited_state, std::vector<WormState>& worms, bool& own_bindings) {
+    if (!(inp >> game.height)) return "Cannot read <row-count>";
+    if (!(inp >> game.width)) return "Cannot read <column-count>";
+    std::string field;
+    if (!(inp >> field)) return "Cannot read <worm-row-position>";
+    worms.clear();
+    own_bindings = false;
+    if (field == "worms") {
+        size_t worm_count;
+        std::string sharing;
+        if (!(inp >> worm_count)) return "Cannot read <worm-count>";
+        if (!(inp >> sharing)) return "Cannot read <shared|own>";
+        if (sharing != "shared" && sharing != "own") return "The bindings of the worms must be `shared` or `own`";
+        if (worm_count == 0) return "There must be at least one worm";
+        own_bindings = sharing == "own";
+        worms.resize(worm_count);
+        for (size_t i = 0; i < worm_count; ++i) {
+            Worm& worm = worms[i].worm;
+            std::string id = std::to_string(i);
+            if (!(inp >> worm.row)) return "Cannot read <worm-row-position-" + id + ">";
+            if (!(inp >> worm.col)) return "Cannot read <worm-col-position-" + id + ">";
+            if (!(inp >> worm.dir)) return "Cannot read <worm-direction-" + id + ">";
+            if (worm.row < 0 || worm.row >= (int)game.height) return "worm #" + id + "'s row position is out of range";
+            if (worm.col < 0 || worm.col >= (int)game.width) return "worm #" + id + "'s column position is out of range";
+            // a worm that died in an earlier run is kept where it is.
+            if (worm.dir < -1 || worm.dir >= 6) return "worm #" + id + "'s direction must be an integer between -1 and 5";
+        }
+        game.worm = worms[0].worm;
+    } else {
+        try {
+            game.worm.row = std::stoi(field);
+        } catch (...) {
+            return "Cannot read <worm-row-position>";
+        }
+        if (!(inp >> game.worm.col)) return "Cannot read <worm-col-position>";
+        if (!(inp >> game.worm.dir)) return "Cannot read <worm-direction>";
+        if (game.worm.row < 0 || game.worm.row >= (int)game.height) return "worm's row position is out of range";
+        if (game.worm.col < 0 || game.worm.col >= (int)game.width) return "worm's column position is out of range";
+        if (game.worm.dir < 0 || game.worm.dir >= 6) return "worm's direction must be an integer between 0 and 5";
+    }
+
+    size_t rule_count;
+    if (!(inp >> rule_count)) return "Cannot read <number-of-rule>";
+    rule.resize(rule_count);
+    for (size_t i = 0; i < rule_count; ++i) {
+        if (!(inp >> rule[i])) return "Cannot read <rule-" + std::to_string(i) + ">";
+        if (rule[i] < 0 || rule[i] >= 6) return "Rule must be an integer between 0 and 5";
+        if (rule[i] == 3) return "Rule must not be 3 (cannot go back)";
+    }
+
+    for (int i = 0; i < (1 << 5); ++i) {
+        visited_state[i] = -1;
+    }
+    total_visited_state = 0;
+    if (own_bindings) {
+        for (auto& w: worms) {
+            std::string error = read_bindings(inp, w.visited_state, w.total_visited_state);
+            if (!error.empty()) return error;
+        }
+    } else {
+        std::string error = read_bindings(inp, visited_state, total_visited_state);
+        if (!error.empty()) return error;
+    }
+    inp >> std::ws;
+    return "";
+}
+
+std::string read_state_board(std::istream& inp, const GameInfo& game, std::vector<std::string>& board_ascii) {
+    board_ascii.resize(2 * game.height);
+    for (size_t i = 0; i < 2 * game.height; ++i) {
+        if (!std::getline(inp, board_ascii[i])) return "Cannot read the row #" + std::to_string(i + 1) + " of the board";
+        if (board_ascii[i].size() < 2 * game.width) {
+            return "The row #" + std::to_string(i + 1) + " of the board is shorter than twice the board size";
+        }
+    }
+    return "";
+}
+
+std::string read_state_file(const std::string& filename, GameInfo& game, std::vector<int>& rule,
+        int* visited_state, size_t& total_visited_state, std::vector<std::string>& board_ascii) {
+    std::ifstream inp(filename);
+    if (!inp) return "Can not open file \"" + filename + "\"";
+    std::vector<WormState> worms;
+    bool own_bindings;
+    std::string error = read_state_header(inp, game, rule, visited_state, total_visited_state, worms, own_bindings);
+    if (!error.empty()) return error;
+    if (!worms.empty()) return "A state file with several worms can only be run on the regions";
+    return read_state_board(inp, game, board_ascii);
+}
+
+static void write_bindings(std::ostream& out, const int* visited, size_t total) {
+    std::vector<int> state(total);
+    for (int i = 0; i < (1 << 5); ++i) {
+        if (visited[i] == -1) continue;
+        state[visited[i]] = i;
+    }
+    out << total << '\n';
+    for (auto x: state) out << x << ' ';
+    out << '\n';
+}
+
+void write_state_header(std::ostream& out, const GameInfo& game, const std::vector<int>& rule,
+        const int* visited_state, size_t total_visited_state,
+        const std::vector<WormState>& worms, bool own_bindings) {
+    out << game.height << ' ' << game.width << '\n';
+    if (!worms.empty()) {
+        out << "worms " << worms.size() << ' ' << (own_bindings ? "own" : "shared") << '\n';
+        for (auto& w: worms) out << w.worm.row << ' ' << w.worm.col << ' ' << w.worm.dir << '\n';
+    } else {
+        out << game.worm.row << ' ' << game.worm.col << ' ' << game.worm.dir << '\n';
+    }
+    out << rule.size() << '\n';
+    for (auto x: rule) out << x << ' ';
+    out << '\n';
+    if (own_bindings) {
+        for (auto& w: worms) write_bindings(out, w.visited_state, w.total_visited_state);
+    } else {
+        write_bindings(out, visited_state, total_visited_state);
+    }
+}
+
+void write_state(std::ostream& out, const GameInfo& game, const std::vector<int>& rule,
+        const int* visited_state, size_t total_visited_state, const std::vector<std::string>& board_ascii,
+        const std::vector<WormState>& worms, bool own_bindings) {
+    write_state_header(out, game, rule, visited_state, total_visited_state, worms, own_bindings);
+    for (auto& line: board_ascii) {
+        out << line << '\n';
+    }
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "state.h"
+
+// The text state file (see print_usage of build/main). The readers return an error message,
+// or an empty string if the file is valid, so the runs that must not exit on a bad file (such
+// as the jobs of a batch or the requests of --serve) read it the same way as build/main.
+
+// Everything but the board, then the blank space up to it. The iteration count of game is
+// left as is. A worm list is put in worms, with game.worm its first worm, and worms is left
+// empty for a file with one worm; when the worms have their own bindings, visited_state is
+// left empty.
+std::string read_state_header(std::istream& inp, GameInfo& game, std::vector<int>& rule,
+        int* visited_state, size_t& total_visited_state, std::vector<WormState>& worms, bool& own_bindings);
+
+// The 2 * height lines of the board, after read_state_header.
+std::string read_state_board(std::istream& inp, const GameInfo& game, std::vector<std::string>& board_ascii);
+
+// The whole file with one worm, a worm list is refused.
+std::string read_state_file(const std::string& filename, GameInfo& game, std::vector<int>& rule,
+        int* visited_state, size_t& total_visited_state, std::vector<std::string>& board_ascii);
+
+// The state in the same format, the worm list when worms is not empty.
+void write_state_header(std::ostream& out, const GameInfo& game, const std::vector<int>& rule,
+        const int* visited_state, size_t total_visited_state,
+        const std::vector<WormState>& worms = {}, bool own_bindings = false);
+void write_state(std::ostream& out, const GameInfo& game, const std::vector<int>& rule,
+        const int* visited_state, size_t total_visited_state, const std::vector<std::string>& board_ascii,
+        const std::vector<WormState>& worms = {}, bool own_bindings = false);
@@ -15,8 +15,26 @@ struct GameInfo {
     Worm worm;
 };
 
+// One worm of a state file with a worm list. The bindings are only used when every worm
+// has its own (see print_usage).
+struct WormState {
+    Worm worm;
+    size_t total_visited_state;
+    int visited_state[1 << 5];
+};
+
+// Everything about the worm that must follow it when it moves to a region of another process.
+struct WormToken {
+    Worm worm;
+    unsigned long iteration_count;
+    unsigned long step_count;
+    int entered;
+    size_t total_visited_state;
+    int visited_state[1 << 5];
+};
+
 
-// these state are only used in the master thread/process
+// these state travel together with the worm (see WormToken)
 extern size_t total_visited_state;
 extern int visited_state[1 << 5];
 extern std::vector<int> rule;
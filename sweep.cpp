@@ -0,0 +1,281 @@
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <mpi.h>
+#include "sweep.h"
+
+extern int world_size;
+extern int world_rank;
+
+static const int rule_values[] = {0, 1, 2, 4, 5};
+// there are only 2^5 reduced states, so a longer rule can never be used entirely.
+static const int max_rule_length = 1 << 5;
+
+enum { SWEEP_TAG_JOB = 1, SWEEP_TAG_RESULT };
+
+std::vector<int> mirror_rule(const std::vector<int>& rule) {
+    std::vector<int> res(rule.size());
+    for (size_t i = 0; i < rule.size(); ++i) {
+        res[i] = (6 - rule[i]) % 6;
+    }
+    return res;
+}
+
+void drop_mirrored(std::vector<std::vector<int>>& rules) {
+    std::set<std::vector<int>> seen;
+    std::vector<std::vector<int>> kept;
+    for (auto& rule: rules) {
+        if (seen.count(mirror_rule(rule))) continue;
+        seen.insert(rule);
+        kept.push_back(rule);
+    }
+    rules.swap(kept);
+}
+
+std::vector<std::vector<int>> enumerate_rules(int max_length) {
+    std::vector<std::vector<int>> rules;
+    max_length = std::min(max_length, max_rule_length);
+    for (int length = 1; length <= max_length; ++length) {
+        std::vector<int> digit(length, 0);
+        while (true) {
+            std::vector<int> rule(length);
+            for (int i = 0; i < length; ++i) rule[i] = rule_values[digit[i]];
+            rules.push_back(rule);
+            int i = length - 1;
+            while (i >= 0 && digit[i] == 4) digit[i--] = 0;
+            if (i < 0) break;
+            ++digit[i];
+        }
+    }
+    return rules;
+}
+
+bool read_rule_list(const std::string& filename, std::vector<std::vector<int>>& rules) {
+    std::ifstream inp(filename);
+    if (!inp) {
+        std::cerr << "Can not open file " << std::quoted(filename) << std::endl;
+        return false;
+    }
+    std::string line;
+    for (int line_id = 1; std::getline(inp, line); ++line_id) {
+        // the rules may be written as in the state file or as in the sweep output.
+        std::replace(line.begin(), line.end(), ',', ' ');
+        std::istringstream ss(line);
+        std::vector<int> rule;
+        int x;
+        while (ss >> x) {
+            if (x < 0 || x >= 6 || x == 3) {
+                std::cerr << "Error while parsing rule list: invalid rule " << x << " at line " << line_id << std::endl;
+                return false;
+            }
+            rule.push_back(x);
+        }
+        if (!ss.eof()) {
+            std::cerr << "Error while parsing rule list: cannot read line " << line_id << std::endl;
+            return false;
+        }
+        if (rule.empty()) continue;
+        if ((int)rule.size() > max_rule_length) {
+            std::cerr << "Error while parsing rule list: the rule at line " << line_id << " has more than "
+                      << max_rule_length << " entries" << std::endl;
+            return false;
+        }
+        rules.push_back(rule);
+    }
+    return true;
+}
+
+bool mirror_symmetric(const SequentialGame& initial) {
+    if (initial.total_visited_state != 0) return false;
+    for (char cell: initial.cells) {
+        if (cell) return false;
+    }
+    size_t height = initial.game.height, width = initial.game.width;
+    switch (initial.game.worm.dir % 3) {
+    // the mirror along the direction 0 maps (r, c) to (-r, c - r).
+    case 0: return height % width == 0;
+    // the mirror along the direction 1 maps (r, c) to (c, r).
+    case 1: return height == width;
+    // the mirror along the direction 2 maps (r, c) to (r - c, -c).
+    default: return width % height == 0;
+    }
+}
+
+static std::string rule_key(const std::vector<int>& rule) {
+    std::string res;
+    for (size_t i = 0; i < rule.size(); ++i) {
+        if (i) res += ',';
+        res += char('0' + rule[i]);
+    }
+    return res;
+}
+
+// FNV-1a over everything of the initial state but the rule.
+static std::string board_key(const SequentialGame& initial) {
+    uint64_t hash = 14695981039346656037ull;
+    auto feed = [&](const void* data, size_t size) {
+        auto bytes = (const unsigned char*)data;
+        for (size_t i = 0; i < size; ++i) {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+    };
+    uint64_t header[] = {
+        initial.game.height, initial.game.width,
+        (uint64_t)initial.game.worm.row, (uint64_t)initial.game.worm.col, (uint64_t)initial.game.worm.dir,
+    };
+    feed(header, sizeof(header));
+    feed(initial.visited_state, sizeof(initial.visited_state));
+    feed(initial.cells.data(), initial.cells.size());
+    std::ostringstream ss;
+    ss << std::hex << std::setw(16) << std::setfill('0') << hash;
+    return ss.str();
+}
+
+// The cache is a text file with a line per finished job:
+//     <board-key> <iteration-count> <rule> <step-count> <died|alive> <row> <col> <dir>
+// where <rule> is comma separated. A result is reused if it was run with the same number
+// of iterations, or if the worm died before running out of them.
+struct CacheEntry {
+    unsigned long iteration_count;
+    SweepResult result;
+};
+
+static std::map<std::string, CacheEntry> read_cache(const std::string& filename, const std::string& board) {
+    std::map<std::string, CacheEntry> cache;
+    std::ifstream inp(filename);
+    std::string line;
+    while (std::getline(inp, line)) {
+        std::istringstream ss(line);
+        std::string key, rule, status;
+        CacheEntry entry;
+        auto& res = entry.result;
+        if (!(ss >> key >> entry.iteration_count >> rule >> res.step_count >> status
+                 >> res.worm.row >> res.worm.col >> res.worm.dir)) continue;
+        if (key != board) continue;
+        res.died = status == "died";
+        cache[rule] = entry;
+    }
+    return cache;
+}
+
+static void print_result(std::ostream& out, const std::vector<int>& rule, const SweepResult& res) {
+    out << rule_key(rule) << ' ' << res.step_count << ' ' << (res.died ? "died" : "alive") << ' '
+        << res.worm.row << ' ' << res.worm.col << ' ' << res.worm.dir;
+}
+
+static SweepResult run_job(const SequentialGame& initial, int job, const std::vector<int>& rule) {
+    SequentialGame game = initial;
+    game.rule = rule;
+    SweepResult res;
+    res.job = job;
+    res.step_count = game.run();
+    res.died = game.game.worm.dir == -1;
+    res.worm = game.game.worm;
+    return res;
+}
+
+static void broadcast_initial(SequentialGame& initial) {
+    MPI_Bcast(&initial.game, sizeof(GameInfo), MPI_BYTE, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&initial.total_visited_state, sizeof(size_t), MPI_BYTE, 0, MPI_COMM_WORLD);
+    MPI_Bcast(initial.visited_state, 1 << 5, MPI_INT, 0, MPI_COMM_WORLD);
+    initial.cells.resize(initial.game.height * initial.game.width);
+    MPI_Bcast(initial.cells.data(), initial.cells.size(), MPI_BYTE, 0, MPI_COMM_WORLD);
+}
+
+// a job on the wire: its index, the rule length, then the rule. An index of -1 means stop.
+static void worker_loop(const SequentialGame& initial) {
+    int job[2 + max_rule_length];
+    SweepResult res;
+    res.job = -1;
+    while (true) {
+        MPI_Send(&res, sizeof(SweepResult), MPI_BYTE, 0, SWEEP_TAG_RESULT, MPI_COMM_WORLD);
+        MPI_Recv(job, 2 + max_rule_length, MPI_INT, 0, SWEEP_TAG_JOB, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        if (job[0] == -1) break;
+        res = run_job(initial, job[0], std::vector<int>(job + 2, job + 2 + job[1]));
+    }
+}
+
+void run_sweep(SequentialGame& initial, const std::vector<std::vector<int>>& rules,
+               const std::string& cache_file) {
+    broadcast_initial(initial);
+    if (world_rank != 0) {
+        worker_loop(initial);
+        return;
+    }
+
+    std::string board = board_key(initial);
+    unsigned long iteration_count = initial.game.iteration_count;
+    std::vector<SweepResult> results(rules.size());
+    std::vector<int> pending;
+    {
+        auto cache = cache_file.empty() ? std::map<std::string, CacheEntry>() : read_cache(cache_file, board);
+        for (int job = 0; job < (int)rules.size(); ++job) {
+            auto it = cache.find(rule_key(rules[job]));
+            if (it != cache.end()) {
+                auto& entry = it->second;
+                if (entry.iteration_count == iteration_count
+                    || (entry.result.died && entry.result.step_count < iteration_count)) {
+                    results[job] = entry.result;
+                    results[job].job = job;
+                    continue;
+                }
+            }
+            pending.push_back(job);
+        }
+    }
+
+    std::ofstream cache_out;
+    if (!cache_file.empty()) {
+        cache_out.open(cache_file, std::ios::app);
+        if (!cache_out) {
+            std::cerr << "Can not open file " << std::quoted(cache_file) << ", results will not be cached" << std::endl;
+        }
+    }
+    auto record = [&](const SweepResult& res) {
+        results[res.job] = res;
+        if (cache_out) {
+            cache_out << board << ' ' << iteration_count << ' ';
+            print_result(cache_out, rules[res.job], res);
+            cache_out << std::endl;
+        }
+    };
+
+    if (world_size == 1) {
+        for (int job: pending) {
+            record(run_job(initial, job, rules[job]));
+        }
+    } else {
+        // the jobs are handed out one by one to whoever finishes first.
+        size_t next = 0;
+        int active = world_size - 1;
+        int job[2 + max_rule_length];
+        while (active > 0) {
+            SweepResult res;
+            MPI_Status status;
+            MPI_Recv(&res, sizeof(SweepResult), MPI_BYTE, MPI_ANY_SOURCE, SWEEP_TAG_RESULT, MPI_COMM_WORLD, &status);
+            if (res.job != -1) record(res);
+            if (next < pending.size()) {
+                auto& rule = rules[pending[next]];
+                job[0] = pending[next++];
+                job[1] = rule.size();
+                std::copy(rule.begin(), rule.end(), job + 2);
+            } else {
+                job[0] = -1;
+                --active;
+            }
+            MPI_Send(job, 2 + max_rule_length, MPI_INT, status.MPI_SOURCE, SWEEP_TAG_JOB, MPI_COMM_WORLD);
+        }
+    }
+
+    std::cout << "# " << rules.size() << " rules, " << rules.size() - pending.size() << " from cache" << std::endl;
+    std::cout << "# <rule> <stepped-iterations> <died|alive> <worm-row> <worm-col> <worm-dir>" << std::endl;
+    for (size_t i = 0; i < rules.size(); ++i) {
+        print_result(std::cout, rules[i], results[i]);
+        std::cout << std::endl;
+    }
+}
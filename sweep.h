@@ -0,0 +1,34 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "sequential-engine.h"
+
+// The outcome of running one rule over the initial board.
+struct SweepResult {
+    int job;
+    unsigned long step_count;
+    int died;
+    Worm worm;
+};
+
+// Enumerates every rule with values 0, 1, 2, 4 and 5 and at most max_length entries.
+std::vector<std::vector<int>> enumerate_rules(int max_length);
+
+// Reads one rule per line. Returns false and prints the error if the file is invalid.
+bool read_rule_list(const std::string& filename, std::vector<std::vector<int>>& rules);
+
+std::vector<int> mirror_rule(const std::vector<int>& rule);
+
+// Drops every rule whose mirror image is already in the list.
+void drop_mirrored(std::vector<std::vector<int>>& rules);
+
+// Whether a rule and its mirror image give the same (mirrored) run on this board: the board
+// must be empty, no state bound in advance, and the torus must be symmetric along the axis
+// of the worm's direction.
+bool mirror_symmetric(const SequentialGame& initial);
+
+// Runs the rules over the initial board on all the processes, each rule as an independent
+// game, and prints the results on the process 0. The rules, the cache and the board only
+// need to be valid on the process 0.
+void run_sweep(SequentialGame& initial, const std::vector<std::vector<int>>& rules,
+               const std::string& cache_file);
@@ -0,0 +1,48 @@
+#include <iomanip>
+#include <sys/resource.h>
+#include "trace.h"
+
+thread_local PhaseStats phase_stats[PHASE_COUNT];
+
+static const char* phase_names[PHASE_COUNT] = {
+    "divide", "halo_column", "halo_row", "halo_corner", "halo_wait",
+    "token", "step", "rule_query", "cell_update", "gather", "checkpoint",
+    "fast_forward",
+};
+
+long max_rss_kb() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+void print_phase_stats(std::ostream& out, const PhaseStats* all_stats, const long* all_rss_kb, int ranks, bool json) {
+    if (json) {
+        out << "[";
+        for (int rank = 0; rank < ranks; ++rank) {
+            out << (rank ? ",\n " : "") << "{\"rank\": " << rank << ", \"max_rss_kb\": " << all_rss_kb[rank];
+            for (int p = 0; p < PHASE_COUNT; ++p) {
+                const PhaseStats& s = all_stats[rank * PHASE_COUNT + p];
+                out << ", \"" << phase_names[p] << "\": {\"count\": " << s.count
+                    << ", \"bytes\": " << s.bytes << ", \"seconds\": " << s.seconds << "}";
+            }
+            out << "}";
+        }
+        out << "]" << std::endl;
+        return;
+    }
+    out << std::left << std::setw(6) << "rank" << std::setw(13) << "phase" << std::right
+        << std::setw(14) << "count" << std::setw(14) << "bytes" << std::setw(14) << "seconds" << std::endl;
+    for (int rank = 0; rank < ranks; ++rank)
+    for (int p = 0; p < PHASE_COUNT; ++p) {
+        const PhaseStats& s = all_stats[rank * PHASE_COUNT + p];
+        if (s.count == 0) continue;
+        out << std::left << std::setw(6) << rank << std::setw(13) << phase_names[p] << std::right
+            << std::setw(14) << s.count << std::setw(14) << s.bytes
+            << std::setw(14) << std::fixed << std::setprecision(6) << s.seconds << std::endl;
+    }
+    out << std::left << std::setw(6) << "rank" << std::right << std::setw(14) << "max-rss-kb" << std::endl;
+    for (int rank = 0; rank < ranks; ++rank) {
+        out << std::left << std::setw(6) << rank << std::right << std::setw(14) << all_rss_kb[rank] << std::endl;
+    }
+}
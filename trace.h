@@ -0,0 +1,83 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+
+// The debug output is compiled in up to LOG_LEVEL (make LOG_LEVEL=...), and printed
+// only when the DEBUG environment variable is set.
+#define LOG_NONE 0
+#define LOG_DEBUG 1
+// every cell update, far too slow for anything but a tiny board.
+#define LOG_TRACE 2
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_DEBUG
+#endif
+
+inline bool log_requested() {
+    static const bool requested = std::getenv("DEBUG") != nullptr;
+    return requested;
+}
+#define LOG_ENABLED(level) ((level) <= LOG_LEVEL && log_requested())
+
+enum Phase {
+    // every process mapping the state file, sharing the line ends of its slice with the
+    // others (the bytes) and decoding its own regions.
+    PHASE_DIVIDE,
+    // the halo pieces sent to the right, down and down-right neighbours.
+    PHASE_HALO_COLUMN,
+    PHASE_HALO_ROW,
+    PHASE_HALO_CORNER,
+    // waiting for the halo pieces before touching a region.
+    PHASE_HALO_WAIT,
+    // the worm token broadcast by the owner.
+    PHASE_TOKEN,
+    // moving the worm inside a region (or the whole board), one count per run.
+    PHASE_STEP,
+    // the rule queries that were not in the transition table yet.
+    PHASE_RULE_QUERY,
+    // the edges drawn by the worm.
+    PHASE_CELL_UPDATE,
+    // the regions sent back to rank 0.
+    PHASE_GATHER,
+    // reading or writing the regions of a binary checkpoint.
+    PHASE_CHECKPOINT,
+    // looking for the periodic moves of the worm and skipping them, one count per search
+    // (within the step phase).
+    PHASE_FAST_FORWARD,
+    PHASE_COUNT
+};
+
+struct PhaseStats {
+    unsigned long count;
+    // the bytes sent by this process.
+    unsigned long bytes;
+    double seconds;
+};
+
+// per thread, reported at exit with --stats (the threads of a batch add theirs to the main one).
+extern thread_local PhaseStats phase_stats[PHASE_COUNT];
+
+// Adds the time until the end of the scope to the phase.
+class PhaseTimer {
+    Phase phase;
+    std::chrono::steady_clock::time_point start;
+public:
+    PhaseTimer(Phase phase_, unsigned long bytes = 0)
+        : phase(phase_)
+        , start(std::chrono::steady_clock::now())
+    {
+        phase_stats[phase].count++;
+        phase_stats[phase].bytes += bytes;
+    }
+    ~PhaseTimer() {
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        phase_stats[phase].seconds += elapsed.count();
+    }
+};
+
+// the peak resident memory of this process so far.
+long max_rss_kb();
+
+// all_stats holds PHASE_COUNT entries for each of the ranks, all_rss_kb one.
+void print_phase_stats(std::ostream& out, const PhaseStats* all_stats, const long* all_rss_kb, int ranks, bool json);
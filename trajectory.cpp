@@ -0,0 +1,84 @@
+#include <cstring>
+#include "trajectory.h"
+
+// the size of a buffer before it is handed to the writer thread.
+static const size_t trajectory_flush_bytes = 1 << 20;
+
+TrajectoryLog::TrajectoryLog(const std::string& filename)
+    : out(filename, std::ios::binary | std::ios::trunc)
+{
+    filling.insert(filling.end(), trajectory_magic, trajectory_magic + sizeof(trajectory_magic));
+    filling.reserve(trajectory_flush_bytes * 2);
+    writing.reserve(trajectory_flush_bytes * 2);
+    writer = std::thread(&TrajectoryLog::write_loop, this);
+}
+
+TrajectoryLog::~TrajectoryLog() {
+    finish();
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cond.notify_all();
+    writer.join();
+}
+
+void TrajectoryLog::write_loop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        cond.wait(lock, [this] { return !writing.empty() || stopping; });
+        if (writing.empty()) return;
+        // the other buffer is only touched by the stepping thread, so the lock is not needed.
+        lock.unlock();
+        out.write(writing.data(), writing.size());
+        lock.lock();
+        writing.clear();
+        cond.notify_all();
+    }
+}
+
+void TrajectoryLog::flush() {
+    std::unique_lock<std::mutex> lock(mutex);
+    cond.wait(lock, [this] { return writing.empty(); });
+    std::swap(filling, writing);
+    cond.notify_all();
+}
+
+void TrajectoryLog::close_block(bool last) {
+    if (block_start == -1) return;
+    if (block.step_count == 0 && !last) {
+        filling.resize(block_start);
+        block_start = -1;
+        return;
+    }
+    if (bit_count) {
+        for (int i = 0; i < bit_count; i += 8) filling.push_back(bits >> i);
+        bits = 0;
+        bit_count = 0;
+    }
+    std::memcpy(&filling[block_start], &block, sizeof(block));
+    block_start = -1;
+    if (filling.size() >= trajectory_flush_bytes) flush();
+}
+
+void TrajectoryLog::open_block(uint64_t step, int row, int col, int dir) {
+    block.first_step = step;
+    block.step_count = 0;
+    block.row = row;
+    block.col = col;
+    block.dir = dir;
+    block_start = filling.size();
+    filling.resize(filling.size() + sizeof(block));
+}
+
+bool TrajectoryLog::finish() {
+    if (!finished) {
+        close_block();
+        flush();
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [this] { return writing.empty(); });
+        out.flush();
+        finished = true;
+    }
+    return (bool)out;
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// The path of the worm, as a file of blocks. Each block starts with a sync record (the
+// absolute place and direction of the worm before its first step), followed by the turn of
+// every step (the new direction minus the old one, mod 6) packed in 3 bits, lowest bits first.
+// A new block starts every trajectory_block_steps steps, and each time the worm arrives
+// in a region of another process. The last block has no step, it holds where the worm
+// ended up (with direction -1 if it died).
+static const char trajectory_magic[8] = {'W', 'O', 'R', 'M', 'T', 'R', 'J', '1'};
+static const uint32_t trajectory_block_steps = 1 << 16;
+
+struct TrajectorySync {
+    uint64_t first_step;
+    uint32_t step_count;
+    int32_t row;
+    int32_t col;
+    int32_t dir;
+};
+
+inline size_t trajectory_block_bytes(uint32_t step_count) {
+    return (step_count * 3 + 7) / 8;
+}
+
+// Fills one buffer while a thread writes the other one to the file, so recording a step
+// never waits for the disk unless the disk is slower than the worm.
+class TrajectoryLog {
+    std::ofstream out;
+    std::vector<char> filling, writing;
+    std::thread writer;
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool stopping = false;
+    bool finished = false;
+
+    // where the header of the open block is in `filling`, -1 if there is none.
+    long block_start = -1;
+    TrajectorySync block;
+    uint32_t bits = 0;
+    int bit_count = 0;
+
+    void write_loop();
+    // a block without any step is dropped, unless it is the last one.
+    void close_block(bool last = false);
+    void open_block(uint64_t step, int row, int col, int dir);
+    // hands `filling` to the writer thread.
+    void flush();
+public:
+    explicit TrajectoryLog(const std::string& filename);
+    ~TrajectoryLog();
+
+    // The worm is at (row, col) with the direction dir before the step number `step`.
+    void sync(uint64_t step, int row, int col, int dir) {
+        close_block();
+        open_block(step, row, col, dir);
+    }
+
+    // A step with the given turn that took the worm to (row, col) with the direction dir.
+    inline void record(int turn, int row, int col, int dir) {
+        bits |= turn << bit_count;
+        bit_count += 3;
+        if (bit_count == 24) {
+            filling.push_back(bits);
+            filling.push_back(bits >> 8);
+            filling.push_back(bits >> 16);
+            bits = 0;
+            bit_count = 0;
+        }
+        if (++block.step_count == trajectory_block_steps) {
+            sync(block.first_step + block.step_count, row, col, dir);
+        }
+    }
+
+    // The last block: the worm is at (row, col) with the direction dir after `step` steps.
+    void end(uint64_t step, int row, int col, int dir) {
+        close_block();
+        open_block(step, row, col, dir);
+        close_block(true);
+    }
+
+    // Waits until everything is written, returns false if the file could not be written.
+    bool finish();
+};